@@ -0,0 +1,47 @@
+#!/bin/sh
+# Banc d'essai des moteurs d'entrées-sorties du serveur.
+#
+# Lance serveur.c avec epoll puis avec io_uring, le charge avec
+# robots.c et compare, pour chaque moteur : le temps processeur du
+# serveur, ses appels système réseau par seconde (dernier bilan
+# complet) et les mesures des robots (latence des touches, gigue).
+#
+# Usage : ./banc-reseau.sh [robots] [durée en s] [virages/s par robot]
+
+ROBOTS=${1:-5000}
+DUREE=${2:-10}
+CADENCE=${3:-1}
+PORT=5199
+TIC=$(getconf CLK_TCK)
+
+gcc -O2 serveur.c -o /tmp/banc-serveur -pthread -lm || exit 1
+gcc -O2 robots.c -o /tmp/banc-robots -pthread -lm || exit 1
+
+# temps processeur (utilisateur + système) d'un processus, en tics
+processeur() {
+    awk '{print $14 + $15}' /proc/$1/stat
+}
+
+for MOTEUR in epoll uring; do
+    /tmp/banc-serveur --tcp $PORT --moteur $MOTEUR > /tmp/banc-$MOTEUR.log &
+    SERVEUR=$!
+    sleep 0.5
+    /tmp/banc-robots --tcp $PORT --robots $ROBOTS --duree $((DUREE + 1)) \
+        --cadence $CADENCE > /tmp/banc-robots-$MOTEUR.log &
+    ROBOTSPID=$!
+    # mesure après la connexion des robots, sur DUREE secondes
+    sleep 1
+    AVANT=$(processeur $SERVEUR)
+    sleep $DUREE
+    APRES=$(processeur $SERVEUR)
+    wait $ROBOTSPID
+    kill $SERVEUR
+    wait $SERVEUR 2> /dev/null
+
+    echo "== $MOTEUR : $ROBOTS robots, $CADENCE virages/s, $DUREE s"
+    awk -v a=$AVANT -v b=$APRES -v d=$DUREE -v t=$TIC \
+        'BEGIN {printf "  processeur du serveur : %.0f ms/s\n", (b - a) * 1000 / t / d}'
+    grep "bilan :" /tmp/banc-$MOTEUR.log | tail -2 | head -1 |
+        sed 's/.* \([0-9]*\) appels réseau.*/  appels système réseau : \1 par seconde/'
+    grep "^  " /tmp/banc-robots-$MOTEUR.log
+done
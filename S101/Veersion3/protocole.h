@@ -0,0 +1,70 @@
+/**
+ * @file protocole.h
+ * @brief Constantes partagées par le jeu, le serveur et les robots.
+ * @author Arthur CHAUVEL
+ * @version 1.0
+ * @date 24/11/24
+ *
+ * Dimensions du plateau, touches de direction et message ETAT :
+ * version4-pave-aleatoire.c (et donc serveur.c, qui l'inclut) et
+ * robots.c les prennent ici, pour parler le même protocole.
+ *
+ * Protocole : le client envoie les touches du jeu (z, q, s, d ;
+ * a pour partir) ; à chaque tick, le serveur lui répond par un
+ * message ETAT de TAILLEETAT octets : type, numéro du tick (32 bits),
+ * vivant, tête x et y, taille (16 bits chacun), puis le nombre de
+ * touches traitées modulo 256, entiers en petit-boutiste.
+ *
+ * Chaque programme est une seule unité de compilation : les
+ * constantes sont définies ici, comme dans le reste du projet.
+ */
+
+#ifndef PROTOCOLE_H
+#define PROTOCOLE_H
+
+#include <stdbool.h>
+
+/** Largeur maximale du plateau de jeu (un programme qui inclut
+ * ce fichier peut la redéfinir avant ; serveur et robots doivent
+ * alors être compilés avec la même valeur). */
+#ifndef LARGEURMAX
+#define LARGEURMAX 80
+#endif
+/** Hauteur maximale du plateau de jeu. */
+#ifndef HAUTEURMAX
+#define HAUTEURMAX 40
+#endif
+/** Taille d'un message ETAT. */
+#define TAILLEETAT 13
+
+/** Caractère permettant d'arrêter le jeu (quitter le serveur). */
+const char ARRET = 'a';
+/** Direction : droite. */
+const char DROITE = 'd';
+/** Direction : gauche. */
+const char GAUCHE = 'q';
+/** Direction : haut. */
+const char HAUT = 'z';
+/** Direction : bas. */
+const char BAS = 's';
+/** Type du message envoyé à chaque tick. */
+const char ETAT = 'T';
+/** Port TCP par défaut du serveur (boucle locale). */
+const int PORTDEFAUT = 5101;
+/** Durée d'un tick du serveur par défaut, en millisecondes. */
+const int TICKDEFAUT = 100;
+
+/**
+ * @brief Indique si une touche change la direction du serpent
+ * (un demi-tour sur place est refusé).
+ * @param touche Touche lue.
+ * @param direction Direction actuelle.
+ */
+static inline bool directionValide(char touche, char direction) {
+    return (touche == DROITE && direction != GAUCHE) ||
+        (touche == GAUCHE && direction != DROITE) ||
+        (touche == HAUT && direction != BAS) ||
+        (touche == BAS && direction != HAUT);
+}
+
+#endif
@@ -0,0 +1,467 @@
+/**
+ * @file robots.c
+ * @brief Générateur de charge pour le serveur du serpent.
+ * @author Arthur CHAUVEL
+ * @version 1.0
+ * @date 24/11/24
+ *
+ * Le programme ouvre des milliers de connexions vers serveur.c sur la
+ * machine locale ; chacune joue un serpent, avec des virages tirés au
+ * hasard, pris dans un script ou choisis par un petit pilote qui évite
+ * les bordures, à une cadence réglable. Les touches envoyées suivent
+ * la règle du jeu (directionValide : pas de demi-tour sur place).
+ *
+ * Le programme mesure :
+ * - la gigue des ticks : écart entre l'arrivée de deux messages ETAT
+ *   et la durée attendue des ticks qui les séparent ;
+ * - la latence d'une touche : de son envoi au message ETAT qui
+ *   l'acquitte (compteur des touches traitées) ;
+ * - le débit : messages reçus et touches envoyées par seconde.
+ *
+ * Compilation : gcc robots.c -o robots -pthread -lm
+ * Usage : ./robots [--unix chemin | --tcp port] [--robots n] [--duree s]
+ *         [--tick ms] [--cadence touches/s] [--mode hasard|script|auto]
+ *         [--script touches]
+ */
+
+#define _GNU_SOURCE
+#include "protocole.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <fcntl.h>
+#include <math.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+/*****************************************************
+*DEFINITIONS CONSANTES/ VARIABLES GLOBALES/ FONCTIONS*
+*****************************************************/
+
+/** Nombre maximal de robots. */
+#define MAXROBOTS 20000
+/** Touches envoyées et pas encore acquittées, au plus (moins que
+ * la file du serveur, pour qu'aucune ne soit jetée). */
+#define MAXENATTENTE 8
+/** Cases de 10 µs des histogrammes (1 s), plus une pour le reste. */
+#define NBCASESHISTO 100000
+/** Largeur d'une case d'histogramme, en nanosecondes. */
+const long PASHISTO = 10000;
+/** Période de la boucle des robots, en millisecondes. */
+const int PERIODEROBOTS = 5;
+/** Distance à la bordure sous laquelle le pilote tourne. */
+const int MARGEPILOTE = 3;
+
+/** @brief Façon dont les robots choisissent leurs virages. */
+typedef enum {
+    MODE_HASARD,                          /**< virage valide au hasard */
+    MODE_SCRIPT,                          /**< touches du script, dans l'ordre */
+    MODE_AUTO                             /**< tourne avant les bordures */
+} ModeRobot;
+
+/** @brief Une connexion et le serpent qu'elle joue. */
+typedef struct {
+    int fd;
+    unsigned char recu[TAILLEETAT];       /**< message ETAT en cours de réception */
+    int nbRecu;
+    bool vivant;
+    int x, y;                             /**< tête au dernier message */
+    char direction;                       /**< direction supposée du serpent */
+    uint32_t tick;                        /**< tick du dernier message */
+    long arrivee;                         /**< heure du dernier message (ns) */
+    long prochaineTouche;                 /**< heure du prochain virage (ns) */
+    unsigned envoyees, acquittees;
+    long envois[MAXENATTENTE];            /**< heure d'envoi des touches en attente */
+    int rangScript;
+} Robot;
+
+/** @brief Histogramme de durées, par cases de PASHISTO. */
+typedef struct {
+    long cases[NBCASESHISTO + 1];
+    long nb;
+    long max;
+} Histogramme;
+
+/** @brief État du générateur. */
+typedef struct {
+    Robot robots[MAXROBOTS];
+    int nbRobots, nbConnectes;
+    int nbDeconnectes;                    /**< connexions fermées par le serveur */
+    int epoll;                            /**< boucle d'événements des sockets */
+    ModeRobot mode;
+    const char *script;
+    double cadence;                       /**< virages par seconde et par robot */
+    long periode;                         /**< durée d'un tick du serveur (ns) */
+    uint64_t graine;
+    Histogramme latence, gigue;
+    long messages, touches, octets;       /**< compteurs depuis le début */
+} Generateur;
+
+/** @brief Générateur unique du programme. */
+Generateur generateur;
+
+int connecter(const char *chemin, int port);
+void recevoir(Generateur *g, Robot *r, long maintenant);
+void traiterEtat(Generateur *g, Robot *r, long maintenant);
+void jouerRobot(Generateur *g, Robot *r, long maintenant);
+char choisirTouche(Generateur *g, Robot *r);
+void noter(Histogramme *h, long duree);
+long centile(const Histogramme *h, double p);
+uint32_t hasard(Generateur *g);
+long nanosecondes();
+
+/*****************************************************
+*               PROGRAMME PRINCIPAL                  *
+*****************************************************/
+
+/**
+ * @brief Connecte les robots, les fait jouer puis affiche les mesures.
+ * @param argc Nombre d'arguments.
+ * @param argv "--unix chemin" ou "--tcp port" désignent le serveur,
+ * "--robots n" le nombre de connexions, "--duree s" la durée du test,
+ * "--tick ms" la durée d'un tick du serveur, "--cadence n" les virages
+ * par seconde et par robot, "--mode hasard|script|auto" leur choix,
+ * "--script touches" les touches jouées en boucle en mode script.
+ * @return Code de sortie du programme.
+ */
+int main(int argc, char *argv[]) {
+    Generateur *g = &generateur;
+    const char *chemin = NULL;
+    int port = PORTDEFAUT, duree = 10, tick = TICKDEFAUT;
+    g->nbRobots = 1000;
+    g->cadence = 1.0;
+    g->mode = MODE_HASARD;
+    g->script = "zqsd";
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--unix") == 0 && i + 1 < argc) chemin = argv[++i];
+        if (strcmp(argv[i], "--tcp") == 0 && i + 1 < argc) port = atoi(argv[++i]);
+        if (strcmp(argv[i], "--robots") == 0 && i + 1 < argc) g->nbRobots = atoi(argv[++i]);
+        if (strcmp(argv[i], "--duree") == 0 && i + 1 < argc) duree = atoi(argv[++i]);
+        if (strcmp(argv[i], "--tick") == 0 && i + 1 < argc) tick = atoi(argv[++i]);
+        if (strcmp(argv[i], "--cadence") == 0 && i + 1 < argc) g->cadence = atof(argv[++i]);
+        if (strcmp(argv[i], "--script") == 0 && i + 1 < argc) g->script = argv[++i];
+        if (strcmp(argv[i], "--mode") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "script") == 0) g->mode = MODE_SCRIPT;
+            if (strcmp(argv[i], "auto") == 0) g->mode = MODE_AUTO;
+        }
+    }
+    if (g->nbRobots < 1 || g->nbRobots > MAXROBOTS) g->nbRobots = MAXROBOTS;
+    if (tick < 1) tick = TICKDEFAUT;
+    g->periode = tick * 1000000L;
+    g->graine = ((uint64_t)time(NULL) ^ ((uint64_t)getpid() << 32)) | 1;
+
+    struct rlimit limite;
+    if (getrlimit(RLIMIT_NOFILE, &limite) == 0 && limite.rlim_cur < MAXROBOTS + 64) {
+        limite.rlim_cur = limite.rlim_max < MAXROBOTS + 64 ? limite.rlim_max : MAXROBOTS + 64;
+        setrlimit(RLIMIT_NOFILE, &limite);
+    }
+
+    g->epoll = epoll_create1(0);
+    long debut = nanosecondes();
+    for (int i = 0; i < g->nbRobots; i++) {
+        Robot *r = &g->robots[i];
+        r->fd = connecter(chemin, port);
+        if (r->fd < 0) {
+            perror("connexion");
+            break;
+        }
+        r->direction = DROITE;
+        r->prochaineTouche = debut + (long)(hasard(g) % 1000) * 1000000L;
+        struct epoll_event ev = {.events = EPOLLIN, .data.ptr = r};
+        epoll_ctl(g->epoll, EPOLL_CTL_ADD, r->fd, &ev);
+        g->nbConnectes++;
+    }
+    printf("%d robots connectés en %.0f ms.\n", g->nbConnectes, (nanosecondes() - debut) / 1e6);
+    fflush(stdout);
+
+    /** Boucle principale : messages du serveur, puis virages dus */
+    struct epoll_event evenements[512];
+    debut = nanosecondes();
+    long fin = debut + duree * 1000000000L, prochainBilan = debut + 1000000000L;
+    long dernierBilan = debut, messagesBilan = 0, touchesBilan = 0;
+    long prochainTour = debut;
+    for (;;) {
+        long maintenant = nanosecondes();
+        if (maintenant >= fin) break;
+        int attente = (prochainTour - maintenant) / 1000000;
+        int n = epoll_wait(g->epoll, evenements, 512, attente > 0 ? attente : 0);
+        maintenant = nanosecondes();
+        for (int k = 0; k < n; k++) {
+            recevoir(g, evenements[k].data.ptr, maintenant);
+        }
+        if (maintenant >= prochainTour) {
+            for (int i = 0; i < g->nbConnectes; i++) {
+                jouerRobot(g, &g->robots[i], maintenant);
+            }
+            prochainTour = maintenant + PERIODEROBOTS * 1000000L;
+        }
+        if (maintenant >= prochainBilan) {
+            double secondes = (maintenant - dernierBilan) / 1e9;
+            printf("%d robots : %.0f messages/s, %.0f touches/s, latence p50 %.2f ms "
+                   "p99 %.2f ms, gigue p50 %.2f ms p99 %.2f ms\n",
+                   g->nbConnectes - g->nbDeconnectes, (g->messages - messagesBilan) / secondes,
+                   (g->touches - touchesBilan) / secondes,
+                   centile(&g->latence, 0.50) / 1e6, centile(&g->latence, 0.99) / 1e6,
+                   centile(&g->gigue, 0.50) / 1e6, centile(&g->gigue, 0.99) / 1e6);
+            fflush(stdout);
+            messagesBilan = g->messages;
+            touchesBilan = g->touches;
+            dernierBilan = maintenant;
+            prochainBilan += 1000000000L;
+        }
+    }
+
+    double secondes = (nanosecondes() - debut) / 1e9;
+    for (int i = 0; i < g->nbConnectes; i++) {
+        if (g->robots[i].fd >= 0) close(g->robots[i].fd);
+    }
+    printf("Bilan sur %.1f s, %d robots :\n", secondes, g->nbConnectes);
+    if (g->nbDeconnectes > 0) {
+        printf("  %d connexions fermées par le serveur\n", g->nbDeconnectes);
+    }
+    printf("  débit : %.0f messages/s (%.0f octets/s), %.0f touches/s\n",
+           g->messages / secondes, g->octets / secondes, g->touches / secondes);
+    printf("  latence des touches (%ld) : p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, "
+           "p99.9 %.2f ms, max %.2f ms\n", g->latence.nb,
+           centile(&g->latence, 0.50) / 1e6, centile(&g->latence, 0.90) / 1e6,
+           centile(&g->latence, 0.99) / 1e6, centile(&g->latence, 0.999) / 1e6,
+           g->latence.max / 1e6);
+    printf("  gigue des ticks (%ld) : p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, "
+           "p99.9 %.2f ms, max %.2f ms\n", g->gigue.nb,
+           centile(&g->gigue, 0.50) / 1e6, centile(&g->gigue, 0.90) / 1e6,
+           centile(&g->gigue, 0.99) / 1e6, centile(&g->gigue, 0.999) / 1e6,
+           g->gigue.max / 1e6);
+    return EXIT_SUCCESS;
+}
+
+/*****************************************************
+*               FONCTIONS/PROCEDURES                *
+*****************************************************/
+
+/**
+ * @brief Temps écoulé, en nanosecondes (horloge monotone).
+ */
+long nanosecondes() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000L + t.tv_nsec;
+}
+
+/**
+ * @brief Tire un nombre pseudo-aléatoire (xorshift64*).
+ * @param g Générateur.
+ */
+uint32_t hasard(Generateur *g) {
+    g->graine ^= g->graine >> 12;
+    g->graine ^= g->graine << 25;
+    g->graine ^= g->graine >> 27;
+    return (uint32_t)((g->graine * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+/**
+ * @brief Ouvre une connexion vers le serveur, non bloquante une fois établie.
+ * @param chemin Socket locale, ou NULL pour TCP sur la boucle locale.
+ * @param port Port TCP.
+ * @return Descripteur, ou -1 en cas d'erreur.
+ */
+int connecter(const char *chemin, int port) {
+    int fd;
+    if (chemin != NULL) {
+        struct sockaddr_un adresse = {.sun_family = AF_UNIX};
+        strncpy(adresse.sun_path, chemin, sizeof(adresse.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, (struct sockaddr *)&adresse, sizeof(adresse)) < 0) return -1;
+    } else {
+        struct sockaddr_in adresse = {
+            .sin_family = AF_INET, .sin_port = htons(port),
+            .sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+        };
+        int oui = 1;
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, (struct sockaddr *)&adresse, sizeof(adresse)) < 0) return -1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &oui, sizeof(oui));
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    return fd;
+}
+
+/**
+ * @brief Lit les messages reçus par un robot.
+ * @param g Générateur.
+ * @param r Robot dont la socket est lisible.
+ * @param maintenant Heure de réception (ns).
+ *
+ * Si le serveur a fermé la connexion (ou en cas d'erreur), la socket
+ * est retirée de la boucle et fermée, et le robot ne joue plus.
+ */
+void recevoir(Generateur *g, Robot *r, long maintenant) {
+    unsigned char tampon[4096];
+    ssize_t n;
+    while ((n = recv(r->fd, tampon, sizeof(tampon), 0)) > 0) {
+        g->octets += n;
+        for (ssize_t k = 0; k < n; k++) {
+            r->recu[r->nbRecu++] = tampon[k];
+            if (r->nbRecu == TAILLEETAT) {
+                if (r->recu[0] == ETAT) traiterEtat(g, r, maintenant);
+                r->nbRecu = 0;
+            }
+        }
+    }
+    if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        epoll_ctl(g->epoll, EPOLL_CTL_DEL, r->fd, NULL);
+        close(r->fd);
+        r->fd = -1;
+        r->vivant = false;
+        g->nbDeconnectes++;
+    }
+}
+
+/**
+ * @brief Lit un entier de 16 bits, octet de poids faible en premier.
+ */
+static int lire16(const unsigned char *o) {
+    return o[0] | (o[1] << 8);
+}
+
+/**
+ * @brief Traite un message ETAT : gigue, acquittements et position.
+ * @param g Générateur.
+ * @param r Robot.
+ * @param maintenant Heure de réception (ns).
+ */
+void traiterEtat(Generateur *g, Robot *r, long maintenant) {
+    uint32_t tick = lire16(r->recu + 1) | ((uint32_t)lire16(r->recu + 3) << 16);
+    bool vivant = r->recu[5];
+    int x = lire16(r->recu + 6), y = lire16(r->recu + 8);
+    g->messages++;
+
+    /** gigue : écart à la durée attendue depuis le message précédent */
+    if (r->arrivee > 0 && tick > r->tick) {
+        long ecart = (maintenant - r->arrivee) - (long)(tick - r->tick) * g->periode;
+        noter(&g->gigue, ecart < 0 ? -ecart : ecart);
+    }
+    r->arrivee = maintenant;
+    r->tick = tick;
+
+    /** acquittement : le compteur du serveur a avancé de "nouvelles" touches */
+    uint8_t nouvelles = (uint8_t)(r->recu[12] - (r->acquittees & 0xFF));
+    for (int k = 0; k < nouvelles && r->acquittees != r->envoyees; k++) {
+        noter(&g->latence, maintenant - r->envois[r->acquittees % MAXENATTENTE]);
+        r->acquittees++;
+    }
+
+    /** direction déduite du déplacement, quand il n'y a pas eu d'issue */
+    if (vivant && r->vivant && r->acquittees == r->envoyees) {
+        int dx = x - r->x, dy = y - r->y;
+        if (dx == 1 && dy == 0) r->direction = DROITE;
+        if (dx == -1 && dy == 0) r->direction = GAUCHE;
+        if (dx == 0 && dy == -1) r->direction = HAUT;
+        if (dx == 0 && dy == 1) r->direction = BAS;
+    }
+    r->vivant = vivant;
+    r->x = x;
+    r->y = y;
+}
+
+/**
+ * @brief Choisit le prochain virage d'un robot.
+ * @param g Générateur.
+ * @param r Robot.
+ * @return Touche à envoyer, ou 0 pour continuer tout droit.
+ */
+char choisirTouche(Generateur *g, Robot *r) {
+    const char touches[4] = {DROITE, GAUCHE, HAUT, BAS};
+    if (g->mode == MODE_SCRIPT) {
+        int longueur = strlen(g->script);
+        for (int essai = 0; essai < longueur; essai++) {
+            char touche = g->script[r->rangScript++ % longueur];
+            if (touche != r->direction && directionValide(touche, r->direction)) return touche;
+        }
+        return 0;
+    }
+    if (g->mode == MODE_AUTO) {
+        /** près d'une bordure, tourner vers le centre du plateau */
+        bool droite = r->direction == DROITE && r->x >= LARGEURMAX - 1 - MARGEPILOTE;
+        bool gauche = r->direction == GAUCHE && r->x <= MARGEPILOTE;
+        bool haut = r->direction == HAUT && r->y <= MARGEPILOTE;
+        bool bas = r->direction == BAS && r->y >= HAUTEURMAX - 1 - MARGEPILOTE;
+        if (droite || gauche) return r->y < HAUTEURMAX / 2 ? BAS : HAUT;
+        if (haut || bas) return r->x < LARGEURMAX / 2 ? DROITE : GAUCHE;
+        if (hasard(g) % 4 != 0) return 0;
+    }
+    for (;;) {
+        char touche = touches[hasard(g) % 4];
+        if (touche != r->direction && directionValide(touche, r->direction)) return touche;
+    }
+}
+
+/**
+ * @brief Envoie le virage d'un robot quand son heure est venue.
+ * @param g Générateur.
+ * @param r Robot.
+ * @param maintenant Heure actuelle (ns).
+ *
+ * Le pilote automatique est consulté à chaque tour de boucle près
+ * des bordures et ne garde qu'une touche en attente ; ailleurs,
+ * les virages suivent la cadence demandée (intervalles
+ * exponentiels). Un robot mort, déconnecté ou dont trop de touches attendent
+ * leur acquittement ne joue pas.
+ */
+void jouerRobot(Generateur *g, Robot *r, long maintenant) {
+    if (g->mode != MODE_AUTO && maintenant < r->prochaineTouche) return;
+    /** le pilote attend de voir l'effet de son dernier virage */
+    unsigned enAttente = g->mode == MODE_AUTO ? 1 : MAXENATTENTE;
+    if (r->fd < 0 || !r->vivant || r->envoyees - r->acquittees >= enAttente) return;
+    if (g->mode == MODE_AUTO && maintenant < r->prochaineTouche &&
+        r->x > MARGEPILOTE && r->x < LARGEURMAX - 1 - MARGEPILOTE &&
+        r->y > MARGEPILOTE && r->y < HAUTEURMAX - 1 - MARGEPILOTE) return;
+    double u = (hasard(g) + 1.0) / 4294967297.0;
+    r->prochaineTouche = maintenant + (long)(-log(u) / g->cadence * 1e9);
+    char touche = choisirTouche(g, r);
+    if (touche == 0) return;
+    if (send(r->fd, &touche, 1, MSG_NOSIGNAL) == 1) {
+        r->envois[r->envoyees % MAXENATTENTE] = maintenant;
+        r->envoyees++;
+        r->direction = touche;
+        g->touches++;
+    }
+}
+
+/**
+ * @brief Ajoute une durée à un histogramme.
+ * @param h Histogramme.
+ * @param duree Durée (ns).
+ */
+void noter(Histogramme *h, long duree) {
+    long k = duree / PASHISTO;
+    h->cases[k < NBCASESHISTO ? k : NBCASESHISTO]++;
+    h->nb++;
+    if (duree > h->max) h->max = duree;
+}
+
+/**
+ * @brief Centile d'un histogramme.
+ * @param h Histogramme.
+ * @param p Fraction entre 0 et 1.
+ * @return Borne haute de la case du centile (ns), 0 si vide.
+ */
+long centile(const Histogramme *h, double p) {
+    long rang = (long)(p * h->nb), cumul = 0;
+    if (h->nb == 0) return 0;
+    for (int k = 0; k < NBCASESHISTO; k++) {
+        cumul += h->cases[k];
+        if (cumul > rang) return (k + 1) * PASHISTO;
+    }
+    return h->max;
+}
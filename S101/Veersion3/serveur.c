@@ -0,0 +1,1707 @@
+/**
+ * @file serveur.c
+ * @brief Serveur de parties du serpent à plusieurs joueurs.
+ * @author Arthur CHAUVEL
+ * @version 1.2
+ * @date 24/11/24
+ *
+ * Le serveur fait vivre des milliers de salles indépendantes, chacune
+ * une partie avec les règles de version4-pave-aleatoire.c : bordures,
+ * issues, pavés et pommes, et jusqu'à --par-salle serpents (au plus
+ * MAXJOUEURSSALLE).
+ * Dans une salle, tous les serpents avancent ensemble à chaque tick ;
+ * une tête qui entre dans une bordure, un pavé ou n'importe quel
+ * serpent, ou dans la même case qu'une autre tête, meurt, et le joueur
+ * repart un peu plus tard ailleurs.
+ *
+ * Chaque salle appartient à un fil de travail, qui a sa propre boucle
+ * d'événements et sa propre minuterie et joue seul les ticks de ses
+ * salles : aucun verrou n'est partagé entre les fils. Le fil principal
+ * accepte les connexions, les dépose dans la file d'arrivée d'une
+ * salle, et déplace de temps en temps une salle d'un fil trop chargé
+ * vers le moins chargé.
+ *
+ * Protocole : le client envoie les touches du jeu (z, q, s, d ;
+ * a pour partir), mises en file par connexion ; à chaque tick,
+ * le serveur lui répond par un message ETAT de TAILLEETAT octets
+ * (protocole.h, partagé avec robots.c).
+ *
+ * Deux moteurs d'entrées-sorties, au choix : epoll, portable, qui
+ * fait un appel système par envoi et par lecture, et io_uring
+ * (Linux 5.19 ou plus), où les acceptations, lectures et envois d'un
+ * tour de boucle partent ensemble en un seul appel, depuis des
+ * tampons enregistrés auprès du noyau. banc-reseau.sh compare les
+ * deux sous la charge de robots.c.
+ *
+ * Par défaut, des salles de PARSALLEDEFAUT serpents sur le plateau du
+ * jeu seul. Le plateau se choisit à la compilation : un grand plateau
+ * partagé, jusqu'à 1024 serpents dans une même salle, s'obtient avec
+ * -DLARGEURMAX=320 -DHAUTEURMAX=160 et --par-salle 1024 (robots.c
+ * compilé avec les mêmes options).
+ *
+ * Compilation : gcc serveur.c -o serveur -pthread -lm
+ * Usage : ./serveur [--unix chemin | --tcp port] [--tick ms]
+ *         [--fils n] [--par-salle n] [--metriques fichier]
+ *         [--moteur epoll|uring]
+ */
+
+#define _GNU_SOURCE
+#define SERPENT_SANS_MAIN
+#include "version4-pave-aleatoire.c"
+#include "protocole.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/io_uring.h>
+
+/*****************************************************
+*DEFINITIONS CONSANTES/ VARIABLES GLOBALES/ FONCTIONS*
+*****************************************************/
+
+/** Nombre maximal de salles. */
+#define MAXSALLES 16384
+/** Nombre maximal de serpents dans une salle (borne de --par-salle). */
+#define MAXJOUEURSSALLE 1024
+/** Nombre maximal de fils de travail. */
+#define MAXTRAVAILLEURS 64
+/** Touches en attente par connexion (puissance de 2). */
+#define TAILLEFILE 16
+/** Nombre maximal de segments d'un serpent du serveur. */
+#define MAXSEGMENTS 4096
+/** Octets en attente d'envoi par connexion. */
+#define TAILLESORTIE 256
+/** Octets lus d'un coup sur une connexion. */
+#define TAILLEENTREE 64
+/** Connexions acceptées au plus, toutes salles confondues. */
+#define MAXCONNEXIONS 20000
+/** Entrées de la file de soumission d'un anneau io_uring (puissance de 2). */
+#define ENTREESANNEAU 4096
+/** Salles cédées dont les opérations io_uring ne sont pas encore finies. */
+#define MAXPARTANTES 16
+/** Serpents par salle par défaut. */
+const int PARSALLEDEFAUT = 8;
+/** Nombre minimal de pommes présentes en même temps dans une salle. */
+const int NBPOMMESSALLE = 8;
+/** Au-delà, une pomme de plus par JOUEURSPARPOMME places de la salle. */
+const int JOUEURSPARPOMME = 16;
+/** Ticks d'attente avant qu'un serpent mort ne reparte. */
+const int DELAIRETOUR = 10;
+/** Période des bilans et de l'équilibrage, en millisecondes. */
+const int PERIODEBILAN = 1000;
+/** Écart de charge entre deux fils, en %, au-delà duquel une salle change de fil. */
+const int DESEQUILIBRE = 25;
+
+/** @brief Messages échangés entre fils par leurs tubes. */
+typedef enum {
+    MSG_SALLE,   /**< prends la salle "salle" */
+    MSG_CEDER    /**< cède au fil "destination" une salle d'au plus "budget" ns par tick */
+} TypeMessage;
+
+/** @brief Message d'un tube, écrit d'un seul bloc (atomique). */
+typedef struct {
+    int type;
+    int salle;
+    int destination;
+    int budget;
+} Message;
+
+/** @brief Moteur d'entrées-sorties des connexions. */
+typedef enum {
+    MOTEUR_EPOLL,   /**< epoll : un appel système par lecture et par envoi */
+    MOTEUR_URING    /**< io_uring : opérations groupées, tampons enregistrés */
+} Moteur;
+
+/** @brief Nature d'une opération io_uring, rangée dans les bits bas
+ * de user_data (un Joueur, alloué par calloc, est aligné sur 16). */
+typedef enum {
+    OP_MINUTERIE = 1,   /**< minuterie prête (attente multiple) */
+    OP_BOITE,           /**< tube des messages prêt (attente multiple) */
+    OP_ANNULATION,      /**< fin d'une annulation, sans suite */
+    OP_ACCEPTATION,     /**< nouvelle connexion (acceptation multiple) */
+    OP_LECTURE,         /**< touches lues dans le casier du joueur */
+    OP_ECRITURE         /**< sortie du casier envoyée */
+} Operation;
+
+/** @brief Masque de la nature d'une opération dans user_data. */
+#define MASQUEOPERATION 7
+
+/** @brief Tampons d'une connexion, rangés par descripteur dans une
+ * même zone que chaque anneau io_uring enregistre une fois pour toutes. */
+typedef struct {
+    unsigned char entree[TAILLEENTREE];   /**< touches lues par io_uring */
+    unsigned char sortie[TAILLESORTIE];   /**< octets pas encore envoyés */
+} Casier;
+
+/** @brief Anneau io_uring d'un fil, projeté en mémoire. */
+typedef struct {
+    int fd;                               /**< -1 si fermé */
+    unsigned *sqTete, *sqQueue;
+    unsigned sqMasque, entrees;
+    struct io_uring_sqe *sqes;
+    unsigned *cqTete, *cqQueue;
+    unsigned cqMasque;
+    struct io_uring_cqe *cqes;
+    unsigned queue;                       /**< queue locale, publiée à la soumission */
+    unsigned aSoumettre;
+    _Atomic long *appels;                 /**< compteur d'appels système à incrémenter */
+} Anneau;
+
+typedef struct Salle Salle;
+
+/** @brief Table de hachage des cases visées par les têtes pendant
+ * un tick (adressage ouvert, sondage linéaire), au moins deux fois
+ * plus grande que la salle pour des sondages courts. */
+typedef struct {
+    Case *cases;
+    uint8_t *nb;                          /**< têtes visant la case, 0 si libre */
+    unsigned masque;                      /**< nombre de cases moins un (puissance de 2) */
+} TableTetes;
+
+/** @brief Un joueur : sa connexion et son serpent. */
+typedef struct {
+    int fd;
+    Salle *salle;
+    int place;                            /**< indice dans salle->joueurs */
+    char file[TAILLEFILE];                /**< touches reçues, pas encore jouées */
+    unsigned debutFile, finFile;
+    unsigned touchesTraitees;             /**< touches jouées, refusées ou jetées */
+    Casier *casier;
+    int aEnvoyer;                         /**< octets de casier->sortie à envoyer */
+    int enVol;                            /**< octets confiés à io_uring, pas encore envoyés */
+    int operations;                       /**< opérations io_uring en cours */
+    bool ferme;                           /**< déconnecté, attend la fin de ses opérations */
+    bool partant;                         /**< sa salle change de fil */
+    bool vivant;
+    int attente;                          /**< ticks avant de repartir */
+    Case corps[MAXSEGMENTS];              /**< anneau : corps[tete] est la tête */
+    int tete, taille, aGrandir;
+    char direction;
+    Case cible;                           /**< case visée pendant le tick */
+    int pommes, morts;
+} Joueur;
+
+/**
+ * @brief Une salle : une partie et ses joueurs.
+ *
+ * Tout ce qui n'est pas atomique n'est touché que par le fil
+ * propriétaire ; les compteurs atomiques sont lus par le fil principal
+ * pour les bilans.
+ */
+struct Salle {
+    Partie monde;                         /**< plateau : bordures, pavés, pommes, serpents */
+    Joueur **joueurs;                     /**< capacite places, NULL si libre */
+    int capacite;
+    int nbJoueurs, nbPommes, maxPommes;
+    int numero;
+    uint32_t tick;
+    TableTetes tetes;
+    int *arrivees;                        /**< connexions déposées par le fil principal */
+    unsigned masqueArrivees;              /**< plus de cases que de places (puissance de 2) */
+    _Atomic unsigned debutArrivees, finArrivees;
+    _Atomic int places;                   /**< places prises ou promises */
+    _Atomic int travailleur;              /**< fil propriétaire */
+    _Atomic long dureeDernier, dureeMax, dureeCumul;   /**< durée des ticks (ns) */
+    _Atomic long ticks, messagesPerdus;
+    int destination;                      /**< fil qui recevra la salle cédée (io_uring) */
+};
+
+/** @brief Un fil de travail et les salles qu'il fait vivre. */
+typedef struct {
+    pthread_t fil;
+    int numero;
+    int epoll, minuterie;
+    Anneau anneau;
+    int boite[2];                         /**< tube des messages reçus : lecture, écriture */
+    Salle *salles[MAXSALLES];
+    int nbSalles;
+    Salle *partantes[MAXPARTANTES];       /**< salles cédées, opérations en cours */
+    int nbPartantes;
+    long debutTick;                       /**< heure prévue du dernier tick (ns) */
+    _Atomic long charge;                  /**< ns passées en ticks depuis le dernier bilan */
+    _Atomic long retardMax, dureeMax;     /**< pire réveil et pire tick (µs) */
+    _Atomic long ticksManques, cessions;
+    _Atomic long appels;                  /**< appels système réseau depuis le dernier bilan */
+} Travailleur;
+
+/** @brief État du serveur. */
+typedef struct {
+    Travailleur travailleurs[MAXTRAVAILLEURS];
+    int nbTravailleurs;
+    Salle *salles[MAXSALLES];
+    int nbSalles;
+    int curseur;                          /**< salle où placer le prochain joueur */
+    int parSalle;                         /**< joueurs par salle */
+    int periode;                          /**< durée d'un tick (ms) */
+    int ecoute, epoll, minuterie;         /**< descripteurs du fil principal */
+    bool suspendu;                        /**< plus de descripteur : acceptations
+                                               reprises au prochain bilan */
+    Anneau anneau;                        /**< anneau du fil principal (io_uring) */
+    Moteur moteur;
+    Casier *casiers;                      /**< un casier par descripteur possible */
+    int nbCasiers;
+    uint64_t graine;
+    _Atomic int nbConnectes;
+    _Atomic long appels;                  /**< appels système réseau du fil principal */
+    const char *metriques;                /**< fichier des métriques par salle */
+} Serveur;
+
+/** @brief Serveur unique du programme. */
+Serveur serveur;
+
+/** @brief Demande d'arrêt (Ctrl-C). */
+volatile sig_atomic_t arretDemande = 0;
+
+Salle *creerSalle(Serveur *s);
+void initMonde(Salle *r, uint64_t graine);
+int ouvrirEcoute(const char *chemin, int port);
+void accepterJoueurs(Serveur *s);
+void placerJoueur(Serveur *s, int fd);
+void posterMessage(Travailleur *t, Message m);
+void *travailler(void *argument);
+void jouerTicks(Travailleur *t, uint64_t expirations);
+void lireMessages(Travailleur *t);
+void adopterSalle(Travailleur *t, Salle *r);
+void cederSalle(Travailleur *t, int destination, long budget);
+void accueillirArrivees(Travailleur *t, Salle *r);
+void jouerSalle(Salle *r);
+void lireJoueur(Joueur *j);
+bool recevoirTouches(Joueur *j, const unsigned char *octets, int n);
+void deconnecter(Joueur *j);
+void envoyer(Joueur *j, const unsigned char *message, int taille);
+int ouvrirAnneau(Anneau *a, unsigned entrees, _Atomic long *appels);
+bool enregistrerCasiers(Anneau *a);
+struct io_uring_sqe *entreeLibre(Anneau *a);
+int soumettreAnneau(Anneau *a, unsigned attendre);
+void attendreEpoll(Travailleur *t);
+void attendreAnneau(Travailleur *t);
+void suivreConnexion(Travailleur *t, Joueur *j);
+void oublierConnexion(Travailleur *t, Joueur *j);
+void fermerConnexion(Travailleur *t, Joueur *j);
+void lancerLecture(Travailleur *t, Joueur *j);
+void lancerEcriture(Travailleur *t, Joueur *j);
+void traiterCompletion(Travailleur *t, uint64_t donnee, int resultat, unsigned drapeaux, bool *messages);
+void verifierPartantes(Travailleur *t);
+bool accueillirAnneau(Serveur *s);
+void avancerTick(Salle *r);
+void diffuserEtats(Salle *r);
+void faireRepartir(Salle *r, Joueur *j);
+void effacerSerpent(Salle *r, Joueur *j);
+bool ajouterPommeSalle(Salle *r);
+void faireBilan(Serveur *s);
+void equilibrer(Serveur *s, const long charges[]);
+long nanosecondes();
+
+/*****************************************************
+*               PROGRAMME PRINCIPAL                  *
+*****************************************************/
+
+/**
+ * @brief Arrête proprement le serveur sur Ctrl-C.
+ */
+static void surSignal(int signal) {
+    (void)signal;
+    arretDemande = 1;
+}
+
+/**
+ * @brief Démarre les fils de travail et accepte les joueurs.
+ * @param argc Nombre d'arguments.
+ * @param argv "--unix chemin" écoute sur une socket locale,
+ * "--tcp port" sur la boucle locale, "--tick ms" règle la cadence,
+ * "--fils n" le nombre de fils de travail (un par cœur par défaut),
+ * "--par-salle n" le nombre de joueurs par salle, "--metriques fichier"
+ * écrit à chaque bilan la durée des ticks de chaque salle, "--moteur
+ * epoll|uring" choisit le moteur d'entrées-sorties (epoll par défaut).
+ * @return Code de sortie du programme.
+ */
+int main(int argc, char *argv[]) {
+    Serveur *s = &serveur;
+    const char *chemin = NULL;
+    int port = PORTDEFAUT;
+    s->periode = TICKDEFAUT;
+    s->parSalle = PARSALLEDEFAUT;
+    s->nbTravailleurs = sysconf(_SC_NPROCESSORS_ONLN);
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--unix") == 0 && i + 1 < argc) chemin = argv[++i];
+        if (strcmp(argv[i], "--tcp") == 0 && i + 1 < argc) port = atoi(argv[++i]);
+        if (strcmp(argv[i], "--tick") == 0 && i + 1 < argc) s->periode = atoi(argv[++i]);
+        if (strcmp(argv[i], "--fils") == 0 && i + 1 < argc) s->nbTravailleurs = atoi(argv[++i]);
+        if (strcmp(argv[i], "--par-salle") == 0 && i + 1 < argc) s->parSalle = atoi(argv[++i]);
+        if (strcmp(argv[i], "--metriques") == 0 && i + 1 < argc) s->metriques = argv[++i];
+        if (strcmp(argv[i], "--moteur") == 0 && i + 1 < argc) {
+            s->moteur = strcmp(argv[++i], "uring") == 0 ? MOTEUR_URING : MOTEUR_EPOLL;
+        }
+    }
+    if (s->nbTravailleurs < 1) s->nbTravailleurs = 1;
+    if (s->nbTravailleurs > MAXTRAVAILLEURS) s->nbTravailleurs = MAXTRAVAILLEURS;
+    if (s->parSalle < 1) s->parSalle = PARSALLEDEFAUT;
+    if (s->parSalle > MAXJOUEURSSALLE) s->parSalle = MAXJOUEURSSALLE;
+    if (s->periode < 1) s->periode = TICKDEFAUT;
+
+    /** autant de descripteurs que de joueurs possibles */
+    struct rlimit limite;
+    if (getrlimit(RLIMIT_NOFILE, &limite) == 0 && limite.rlim_cur < MAXCONNEXIONS + 256) {
+        limite.rlim_cur = limite.rlim_max < MAXCONNEXIONS + 256 ? limite.rlim_max : MAXCONNEXIONS + 256;
+        setrlimit(RLIMIT_NOFILE, &limite);
+    }
+    signal(SIGPIPE, SIG_IGN);
+    /** un casier par descripteur : aucun descripteur ne dépasse la limite */
+    s->nbCasiers = getrlimit(RLIMIT_NOFILE, &limite) == 0 && limite.rlim_cur < INT32_MAX
+        ? (int)limite.rlim_cur : MAXCONNEXIONS + 256;
+    s->casiers = calloc(s->nbCasiers, sizeof(Casier));
+    if (s->casiers == NULL) {
+        perror("casiers");
+        return EXIT_FAILURE;
+    }
+
+    initPortails();
+    initZobrist();
+    s->graine = (uint64_t)time(NULL) ^ ((uint64_t)getpid() << 32);
+
+    s->ecoute = ouvrirEcoute(chemin, port);
+    if (s->ecoute < 0) {
+        perror("écoute");
+        return EXIT_FAILURE;
+    }
+
+    /** les anneaux sont prêts avant les fils : sans io_uring, epoll */
+    if (s->moteur == MOTEUR_URING) {
+        bool pret = ouvrirAnneau(&s->anneau, ENTREESANNEAU, &s->appels) == 0;
+        for (int i = 0; i < s->nbTravailleurs && pret; i++) {
+            Travailleur *t = &s->travailleurs[i];
+            pret = ouvrirAnneau(&t->anneau, ENTREESANNEAU, &t->appels) == 0 &&
+                   enregistrerCasiers(&t->anneau);
+        }
+        if (!pret) {
+            perror("io_uring, repli sur epoll");
+            s->moteur = MOTEUR_EPOLL;
+        } else {
+            /** les opérations io_uring attendent d'elles-mêmes */
+            fcntl(s->ecoute, F_SETFL, 0);
+        }
+    }
+
+    /** les fils de travail ne reçoivent pas les signaux */
+    sigset_t signaux;
+    sigemptyset(&signaux);
+    sigaddset(&signaux, SIGINT);
+    sigaddset(&signaux, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signaux, NULL);
+    for (int i = 0; i < s->nbTravailleurs; i++) {
+        Travailleur *t = &s->travailleurs[i];
+        t->numero = i;
+        if (pipe2(t->boite, O_CLOEXEC) < 0) {
+            perror("tube");
+            return EXIT_FAILURE;
+        }
+        fcntl(t->boite[0], F_SETFL, O_NONBLOCK);
+        fcntl(t->boite[1], F_SETPIPE_SZ, 1 << 20);
+        pthread_create(&t->fil, NULL, travailler, t);
+    }
+    pthread_sigmask(SIG_UNBLOCK, &signaux, NULL);
+    signal(SIGINT, surSignal);
+    signal(SIGTERM, surSignal);
+
+    s->minuterie = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    struct itimerspec cadence = {
+        .it_interval = {PERIODEBILAN / 1000, (PERIODEBILAN % 1000) * 1000000L},
+        .it_value = {PERIODEBILAN / 1000, (PERIODEBILAN % 1000) * 1000000L}
+    };
+    timerfd_settime(s->minuterie, 0, &cadence, NULL);
+
+    printf("Serveur prêt (%s, %s), %d fils, %d joueurs par salle, tick de %d ms.\n",
+           chemin != NULL ? chemin : "tcp", s->moteur == MOTEUR_URING ? "io_uring" : "epoll",
+           s->nbTravailleurs, s->parSalle, s->periode);
+    fflush(stdout);
+
+    /** Boucle du fil principal : connexions et bilans */
+    bool sain = true;
+    if (s->moteur == MOTEUR_URING) {
+        sain = accueillirAnneau(s);
+    } else {
+        s->epoll = epoll_create1(0);
+        struct epoll_event ev = {.events = EPOLLIN, .data.fd = s->ecoute};
+        epoll_ctl(s->epoll, EPOLL_CTL_ADD, s->ecoute, &ev);
+        ev.data.fd = s->minuterie;
+        epoll_ctl(s->epoll, EPOLL_CTL_ADD, s->minuterie, &ev);
+        struct epoll_event evenements[64];
+        while (!arretDemande) {
+            int n = epoll_wait(s->epoll, evenements, 64, -1);
+            atomic_fetch_add_explicit(&s->appels, 1, memory_order_relaxed);
+            for (int k = 0; k < n; k++) {
+                if (evenements[k].data.fd == s->ecoute) {
+                    accepterJoueurs(s);
+                } else {
+                    uint64_t expirations;
+                    if (read(s->minuterie, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+                        faireBilan(s);
+                    }
+                    if (s->suspendu) {
+                        struct epoll_event reprise = {.events = EPOLLIN, .data.fd = s->ecoute};
+                        epoll_ctl(s->epoll, EPOLL_CTL_ADD, s->ecoute, &reprise);
+                        s->suspendu = false;
+                    }
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < s->nbTravailleurs; i++) {
+        pthread_join(s->travailleurs[i].fil, NULL);
+    }
+    close(s->ecoute);
+    if (chemin != NULL) unlink(chemin);
+    printf("Serveur arrêté, %d salles.\n", s->nbSalles);
+    return sain ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*****************************************************
+*               FONCTIONS/PROCEDURES                *
+*****************************************************/
+
+/**
+ * @brief Temps écoulé, en nanosecondes (horloge monotone).
+ */
+long nanosecondes() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000L + t.tv_nsec;
+}
+
+/**
+ * @brief Crée une salle et la confie à un fil, à tour de rôle.
+ * @param s Serveur.
+ * @return La salle, ou NULL si MAXSALLES est atteint.
+ */
+Salle *creerSalle(Serveur *s) {
+    if (s->nbSalles == MAXSALLES) return NULL;
+    Salle *r = calloc(1, sizeof(Salle));
+    if (r == NULL) return NULL;
+    /** places, file d'arrivée et table des têtes suivent la taille de la salle */
+    r->capacite = s->parSalle;
+    unsigned taille = 16;
+    while (taille <= (unsigned)r->capacite) taille *= 2;
+    r->masqueArrivees = taille - 1;
+    r->tetes.masque = 2 * taille - 1;
+    r->joueurs = calloc(r->capacite, sizeof(Joueur *));
+    r->arrivees = calloc(taille, sizeof(int));
+    r->tetes.cases = calloc(2 * taille, sizeof(Case));
+    r->tetes.nb = calloc(2 * taille, sizeof(uint8_t));
+    if (r->joueurs == NULL || r->arrivees == NULL || r->tetes.cases == NULL || r->tetes.nb == NULL) {
+        free(r->joueurs);
+        free(r->arrivees);
+        free(r->tetes.cases);
+        free(r->tetes.nb);
+        free(r);
+        return NULL;
+    }
+    r->numero = s->nbSalles;
+    initMonde(r, s->graine + 0x9E3779B97F4A7C15ULL * (r->numero + 1));
+    int t = r->numero % s->nbTravailleurs;
+    atomic_store(&r->travailleur, t);
+    s->salles[s->nbSalles++] = r;
+    posterMessage(&s->travailleurs[t], (Message){.type = MSG_SALLE, .salle = r->numero});
+    return r;
+}
+
+/**
+ * @brief Prépare le plateau d'une salle : bordures, issues, pavés et pommes.
+ * @param r Salle.
+ * @param graine Graine du générateur du plateau.
+ *
+ * Le plateau est celui d'une partie du jeu seul, dont on retire
+ * le serpent de départ. Les grandes salles ont plus de pommes.
+ */
+void initMonde(Salle *r, uint64_t graine) {
+    Partie *m = &r->monde;
+    initPartie(m, graine);
+    for (int i = 0; i < m->tailleSerpent; i++) {
+        CASEPLATEAU(m, SEGMENT(m, i)) = VIDE;
+    }
+    m->tailleSerpent = 0;
+    r->maxPommes = r->capacite / JOUEURSPARPOMME;
+    if (r->maxPommes < NBPOMMESSALLE) r->maxPommes = NBPOMMESSALLE;
+    r->nbPommes = 1;
+    while (r->nbPommes < r->maxPommes && ajouterPommeSalle(r)) {
+    }
+}
+
+/**
+ * @brief Ouvre la socket d'écoute, non bloquante.
+ * @param chemin Socket locale, ou NULL pour TCP sur la boucle locale.
+ * @param port Port TCP.
+ * @return Descripteur, ou -1 en cas d'erreur.
+ */
+int ouvrirEcoute(const char *chemin, int port) {
+    int fd;
+    if (chemin != NULL) {
+        struct sockaddr_un adresse = {.sun_family = AF_UNIX};
+        strncpy(adresse.sun_path, chemin, sizeof(adresse.sun_path) - 1);
+        unlink(chemin);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (fd < 0 || bind(fd, (struct sockaddr *)&adresse, sizeof(adresse)) < 0) return -1;
+    } else {
+        struct sockaddr_in adresse = {
+            .sin_family = AF_INET, .sin_port = htons(port),
+            .sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+        };
+        int oui = 1;
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (fd < 0) return -1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &oui, sizeof(oui));
+        if (bind(fd, (struct sockaddr *)&adresse, sizeof(adresse)) < 0) return -1;
+    }
+    if (listen(fd, SOMAXCONN) < 0) return -1;
+    return fd;
+}
+
+/**
+ * @brief Accepte toutes les connexions en attente (epoll).
+ * @param s Serveur.
+ *
+ * Faute de descripteur (EMFILE, ENFILE), la connexion reste en
+ * attente et l'écoute, toujours prête, réveillerait epoll sans fin :
+ * elle est retirée jusqu'au prochain bilan.
+ */
+void accepterJoueurs(Serveur *s) {
+    for (;;) {
+        int fd = accept4(s->ecoute, NULL, NULL, SOCK_NONBLOCK);
+        atomic_fetch_add_explicit(&s->appels, 1, memory_order_relaxed);
+        if (fd < 0 && (errno == EMFILE || errno == ENFILE)) {
+            perror("accept");
+            epoll_ctl(s->epoll, EPOLL_CTL_DEL, s->ecoute, NULL);
+            s->suspendu = true;
+        }
+        if (fd < 0) return;
+        placerJoueur(s, fd);
+    }
+}
+
+/**
+ * @brief Confie une nouvelle connexion à une salle.
+ * @param s Serveur.
+ * @param fd Connexion acceptée.
+ *
+ * Chaque connexion est promise à la première salle qui a une place,
+ * en partant de la dernière remplie, ou à une nouvelle salle ; elle
+ * est déposée dans la file d'arrivée de la salle, que le fil
+ * propriétaire vide au tick suivant.
+ */
+void placerJoueur(Serveur *s, int fd) {
+    if (atomic_load(&s->nbConnectes) >= MAXCONNEXIONS || fd >= s->nbCasiers) {
+        close(fd);
+        return;
+    }
+    Salle *r = NULL;
+    for (int k = 0; k < s->nbSalles && r == NULL; k++) {
+        Salle *essai = s->salles[(s->curseur + k) % s->nbSalles];
+        /** seul ce fil ajoute des places : lire puis ajouter suffit */
+        if (atomic_load(&essai->places) < s->parSalle) r = essai;
+    }
+    if (r == NULL) r = creerSalle(s);
+    if (r == NULL) {
+        close(fd);
+        return;
+    }
+    s->curseur = r->numero;
+    int oui = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &oui, sizeof(oui));
+    atomic_fetch_add(&r->places, 1);
+    atomic_fetch_add(&s->nbConnectes, 1);
+    unsigned fin = atomic_load_explicit(&r->finArrivees, memory_order_relaxed);
+    r->arrivees[fin & r->masqueArrivees] = fd;
+    atomic_store_explicit(&r->finArrivees, fin + 1, memory_order_release);
+}
+
+/**
+ * @brief Écrit un message dans le tube d'un fil.
+ * @param t Fil destinataire.
+ * @param m Message.
+ *
+ * Un message fait moins de PIPE_BUF octets : plusieurs fils peuvent
+ * écrire dans le même tube sans se mélanger.
+ */
+void posterMessage(Travailleur *t, Message m) {
+    while (write(t->boite[1], &m, sizeof(m)) < 0 && errno == EINTR) {
+    }
+}
+
+/**
+ * @brief Boucle d'un fil de travail.
+ * @param argument Le Travailleur.
+ *
+ * La minuterie du fil donne la cadence : à chaque expiration, chaque
+ * salle du fil joue un tick. Entre deux ticks, le fil lit les touches
+ * de ses joueurs et les messages de son tube.
+ */
+void *travailler(void *argument) {
+    Travailleur *t = argument;
+    Serveur *s = &serveur;
+    t->minuterie = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    struct itimerspec cadence = {
+        .it_interval = {s->periode / 1000, (s->periode % 1000) * 1000000L},
+        .it_value = {s->periode / 1000, (s->periode % 1000) * 1000000L}
+    };
+    timerfd_settime(t->minuterie, 0, &cadence, NULL);
+    if (s->moteur == MOTEUR_URING) {
+        /** attentes multiples : une complétion à chaque réveil */
+        struct io_uring_sqe *e = entreeLibre(&t->anneau);
+        e->opcode = IORING_OP_POLL_ADD;
+        e->fd = t->minuterie;
+        e->poll32_events = POLLIN;
+        e->len = IORING_POLL_ADD_MULTI;
+        e->user_data = OP_MINUTERIE;
+        e = entreeLibre(&t->anneau);
+        e->opcode = IORING_OP_POLL_ADD;
+        e->fd = t->boite[0];
+        e->poll32_events = POLLIN;
+        e->len = IORING_POLL_ADD_MULTI;
+        e->user_data = OP_BOITE;
+    } else {
+        t->epoll = epoll_create1(0);
+        /** data.ptr : NULL pour la minuterie, le fil pour son tube, un Joueur sinon */
+        struct epoll_event ev = {.events = EPOLLIN, .data.ptr = NULL};
+        epoll_ctl(t->epoll, EPOLL_CTL_ADD, t->minuterie, &ev);
+        ev.data.ptr = t;
+        epoll_ctl(t->epoll, EPOLL_CTL_ADD, t->boite[0], &ev);
+    }
+
+    t->debutTick = nanosecondes();
+    while (!arretDemande) {
+        if (s->moteur == MOTEUR_URING) attendreAnneau(t);
+        else attendreEpoll(t);
+    }
+
+    /** l'anneau fermé, le noyau abandonne les opérations en cours */
+    if (s->moteur == MOTEUR_URING) {
+        close(t->anneau.fd);
+        t->anneau.fd = -1;
+    } else {
+        close(t->epoll);
+    }
+    for (int i = 0; i < t->nbSalles; i++) {
+        Salle *r = t->salles[i];
+        for (int k = 0; k < r->capacite; k++) {
+            if (r->joueurs[k] != NULL) deconnecter(r->joueurs[k]);
+        }
+    }
+    close(t->minuterie);
+    return NULL;
+}
+
+/**
+ * @brief Joue un tick de chaque salle d'un fil, à l'expiration
+ * de sa minuterie.
+ * @param t Fil.
+ * @param expirations Expirations depuis la dernière lecture.
+ */
+void jouerTicks(Travailleur *t, uint64_t expirations) {
+    long maintenant = nanosecondes();
+    t->debutTick += expirations * serveur.periode * 1000000L;
+    long retard = (maintenant - t->debutTick) / 1000;
+    if (retard > atomic_load_explicit(&t->retardMax, memory_order_relaxed)) {
+        atomic_store_explicit(&t->retardMax, retard, memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&t->ticksManques, expirations - 1, memory_order_relaxed);
+    for (int i = 0; i < t->nbSalles; i++) {
+        accueillirArrivees(t, t->salles[i]);
+        jouerSalle(t->salles[i]);
+    }
+    long duree = nanosecondes() - maintenant;
+    atomic_fetch_add_explicit(&t->charge, duree, memory_order_relaxed);
+    if (duree / 1000 > atomic_load_explicit(&t->dureeMax, memory_order_relaxed)) {
+        atomic_store_explicit(&t->dureeMax, duree / 1000, memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Traite les messages du tube d'un fil.
+ * @param t Fil.
+ */
+void lireMessages(Travailleur *t) {
+    Message messages[64];
+    ssize_t n;
+    /** les écritures font toutes sizeof(Message) octets, la lecture
+     * rend donc toujours des messages entiers */
+    while ((n = read(t->boite[0], messages, sizeof(messages))) > 0) {
+        for (int k = 0; k < n / (ssize_t)sizeof(Message); k++) {
+            if (messages[k].type == MSG_SALLE) {
+                adopterSalle(t, serveur.salles[messages[k].salle]);
+            } else {
+                cederSalle(t, messages[k].destination, messages[k].budget);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Ajoute une salle (nouvelle ou cédée) aux salles d'un fil.
+ * @param t Fil.
+ * @param r Salle.
+ */
+void adopterSalle(Travailleur *t, Salle *r) {
+    t->salles[t->nbSalles++] = r;
+    atomic_store(&r->travailleur, t->numero);
+    for (int k = 0; k < r->capacite; k++) {
+        if (r->joueurs[k] != NULL) suivreConnexion(t, r->joueurs[k]);
+    }
+}
+
+/**
+ * @brief Cède à un autre fil la salle la plus coûteuse qui tient
+ * dans le budget.
+ * @param t Fil trop chargé.
+ * @param destination Numéro du fil le moins chargé.
+ * @param budget Durée de tick maximale de la salle cédée (ns).
+ *
+ * Les connexions de la salle quittent la boucle de ce fil ;
+ * les touches non lues restent dans les sockets et seront lues
+ * par le nouveau fil. Avec io_uring, la salle n'est envoyée qu'une
+ * fois finies les opérations de ses joueurs sur l'anneau de ce fil.
+ */
+void cederSalle(Travailleur *t, int destination, long budget) {
+    int choix = -1;
+    long meilleure = 0;
+    for (int i = 0; i < t->nbSalles; i++) {
+        long d = atomic_load_explicit(&t->salles[i]->dureeDernier, memory_order_relaxed);
+        if (t->salles[i]->nbJoueurs > 0 && d <= budget && d > meilleure) {
+            meilleure = d;
+            choix = i;
+        }
+    }
+    if (choix < 0 || t->nbSalles < 2 || t->nbPartantes == MAXPARTANTES) return;
+    Salle *r = t->salles[choix];
+    t->salles[choix] = t->salles[--t->nbSalles];
+    for (int k = 0; k < r->capacite; k++) {
+        if (r->joueurs[k] != NULL) oublierConnexion(t, r->joueurs[k]);
+    }
+    atomic_fetch_add_explicit(&t->cessions, 1, memory_order_relaxed);
+    r->destination = destination;
+    t->partantes[t->nbPartantes++] = r;
+    verifierPartantes(t);
+}
+
+/**
+ * @brief Installe dans une salle les connexions déposées par le fil principal.
+ * @param t Fil propriétaire.
+ * @param r Salle.
+ *
+ * Chaque nouveau joueur prend une place libre et part au tick suivant.
+ */
+void accueillirArrivees(Travailleur *t, Salle *r) {
+    unsigned fin = atomic_load_explicit(&r->finArrivees, memory_order_acquire);
+    unsigned debut = atomic_load_explicit(&r->debutArrivees, memory_order_relaxed);
+    for (; debut != fin; debut++) {
+        int place = 0;
+        while (r->joueurs[place] != NULL) place++;
+        Joueur *j = calloc(1, sizeof(Joueur));
+        if (j == NULL) {
+            /** la connexion est refusée : sa place est rendue */
+            close(r->arrivees[debut & r->masqueArrivees]);
+            atomic_fetch_sub(&r->places, 1);
+            atomic_fetch_sub(&serveur.nbConnectes, 1);
+            continue;
+        }
+        j->fd = r->arrivees[debut & r->masqueArrivees];
+        j->casier = &serveur.casiers[j->fd];
+        j->salle = r;
+        j->place = place;
+        r->joueurs[place] = j;
+        r->nbJoueurs++;
+        suivreConnexion(t, j);
+    }
+    atomic_store_explicit(&r->debutArrivees, debut, memory_order_release);
+}
+
+/**
+ * @brief Joue un tick d'une salle et note sa durée.
+ * @param r Salle.
+ */
+void jouerSalle(Salle *r) {
+    if (r->nbJoueurs == 0) return;
+    long debut = nanosecondes();
+    avancerTick(r);
+    diffuserEtats(r);
+    long duree = nanosecondes() - debut;
+    atomic_store_explicit(&r->dureeDernier, duree, memory_order_relaxed);
+    if (duree > atomic_load_explicit(&r->dureeMax, memory_order_relaxed)) {
+        atomic_store_explicit(&r->dureeMax, duree, memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&r->dureeCumul, duree, memory_order_relaxed);
+    atomic_fetch_add_explicit(&r->ticks, 1, memory_order_relaxed);
+}
+
+/**
+ * @brief Fil propriétaire de la salle d'un joueur.
+ */
+static inline Travailleur *proprietaire(const Joueur *j) {
+    return &serveur.travailleurs[atomic_load_explicit(&j->salle->travailleur, memory_order_relaxed)];
+}
+
+/**
+ * @brief Lit les touches d'un joueur dont la socket est lisible (epoll).
+ * @param j Joueur.
+ */
+void lireJoueur(Joueur *j) {
+    unsigned char tampon[256];
+    Travailleur *t = proprietaire(j);
+    for (;;) {
+        ssize_t n = recv(j->fd, tampon, sizeof(tampon), 0);
+        atomic_fetch_add_explicit(&t->appels, 1, memory_order_relaxed);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            deconnecter(j);
+            return;
+        }
+        if (n < 0 || !recevoirTouches(j, tampon, n)) return;
+    }
+}
+
+/**
+ * @brief Met dans la file d'un joueur les touches reçues.
+ * @param j Joueur.
+ * @param octets Octets reçus.
+ * @param n Nombre d'octets.
+ * @return false si le joueur s'est déconnecté (touche ARRET).
+ *
+ * Quand la file est pleine, les touches les plus récentes sont
+ * ignorées ; la touche ARRET ou une fin de connexion libère la place.
+ */
+bool recevoirTouches(Joueur *j, const unsigned char *octets, int n) {
+    for (int k = 0; k < n; k++) {
+        if (octets[k] == ARRET) {
+            deconnecter(j);
+            return false;
+        }
+        if (DELTA[octets[k] & 127] == 0) continue;
+        if (j->finFile - j->debutFile < TAILLEFILE) {
+            j->file[j->finFile++ % TAILLEFILE] = octets[k];
+        } else {
+            j->touchesTraitees++;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Retire le serpent d'un joueur, libère sa place et ferme
+ * sa connexion.
+ * @param j Joueur.
+ */
+void deconnecter(Joueur *j) {
+    Salle *r = j->salle;
+    if (j->vivant) effacerSerpent(r, j);
+    r->joueurs[j->place] = NULL;
+    r->nbJoueurs--;
+    atomic_fetch_sub(&r->places, 1);
+    atomic_fetch_sub(&serveur.nbConnectes, 1);
+    fermerConnexion(proprietaire(j), j);
+}
+
+/**
+ * @brief Envoie un message sans bloquer.
+ * @param j Joueur destinataire.
+ * @param message Octets du message.
+ * @param taille Nombre d'octets.
+ *
+ * Le message rejoint la sortie du casier du joueur. Avec epoll, la
+ * sortie part tout de suite et ce que la socket refuse attend le tick
+ * suivant ; avec io_uring, une écriture est préparée sur l'anneau et
+ * part avec les autres au prochain appel. Un client trop lent pour
+ * vider sa sortie perd le message.
+ */
+void envoyer(Joueur *j, const unsigned char *message, int taille) {
+    Casier *c = j->casier;
+    if (j->aEnvoyer + taille > TAILLESORTIE) {
+        atomic_fetch_add_explicit(&j->salle->messagesPerdus, 1, memory_order_relaxed);
+        return;
+    }
+    memcpy(c->sortie + j->aEnvoyer, message, taille);
+    j->aEnvoyer += taille;
+    if (serveur.moteur == MOTEUR_URING) {
+        if (j->enVol == 0) lancerEcriture(proprietaire(j), j);
+        return;
+    }
+    ssize_t n = send(j->fd, c->sortie, j->aEnvoyer, MSG_NOSIGNAL | MSG_DONTWAIT);
+    atomic_fetch_add_explicit(&proprietaire(j)->appels, 1, memory_order_relaxed);
+    if (n > 0) {
+        memmove(c->sortie, c->sortie + n, j->aEnvoyer - n);
+        j->aEnvoyer -= n;
+    }
+}
+
+/**
+ * @brief Case d'un segment du serpent d'un joueur (0 pour la tête).
+ */
+static inline Case segment(const Joueur *j, int i) {
+    return j->corps[(j->tete + i) % MAXSEGMENTS];
+}
+
+/**
+ * @brief Retire du plateau toutes les cases d'un serpent.
+ * @param r Salle.
+ * @param j Joueur.
+ */
+void effacerSerpent(Salle *r, Joueur *j) {
+    for (int i = 0; i < j->taille; i++) {
+        CASEPLATEAU(&r->monde, segment(j, i)) = VIDE;
+    }
+    j->vivant = false;
+}
+
+/**
+ * @brief Fait repartir un serpent d'une case au hasard, libre
+ * ainsi que la case devant lui.
+ * @param r Salle.
+ * @param j Joueur.
+ *
+ * Le serpent part sur une seule case et grandit jusqu'à
+ * TAILLESERPENT en avançant.
+ */
+void faireRepartir(Salle *r, Joueur *j) {
+    Partie *m = &r->monde;
+    const char touches[4] = {DROITE, GAUCHE, HAUT, BAS};
+    for (int essai = 0; essai < 100; essai++) {
+        Case c = CASE(aleatoire(m) % (LARGEURMAX - 2) + 1, aleatoire(m) % (HAUTEURMAX - 2) + 1);
+        char d = touches[aleatoire(m) % 4];
+        Case devant = redirection[c + DELTA[(unsigned char)d]];
+        if (CASEPLATEAU(m, c) != VIDE || redirection[c] != c || CASEPLATEAU(m, devant) != VIDE) continue;
+        j->tete = 0;
+        j->corps[0] = c;
+        j->taille = 1;
+        j->aGrandir = TAILLESERPENT - 1;
+        j->direction = d;
+        j->vivant = true;
+        j->touchesTraitees += j->finFile - j->debutFile;
+        j->debutFile = j->finFile;
+        CASEPLATEAU(m, c) = TETE;
+        return;
+    }
+}
+
+/**
+ * @brief Pose une pomme sur une case vide au hasard.
+ * @param r Salle.
+ * @return false si aucune case n'a été trouvée.
+ */
+bool ajouterPommeSalle(Salle *r) {
+    Partie *m = &r->monde;
+    for (int essai = 0; essai < 100; essai++) {
+        Case c = CASE(aleatoire(m) % (LARGEURMAX - 2) + 1, aleatoire(m) % (HAUTEURMAX - 2) + 1);
+        if (CASEPLATEAU(m, c) == VIDE && redirection[c] == c) {
+            CASEPLATEAU(m, c) = POMME;
+            r->nbPommes++;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Emplacement d'une case dans la table des têtes.
+ * @param t Table.
+ * @param c Case visée.
+ * @return Indice de la case, ou de l'emplacement libre où la ranger.
+ */
+static int placeTete(const TableTetes *t, Case c) {
+    int k = ((uint32_t)c * 0x9E3779B1u >> 16) & t->masque;
+    while (t->nb[k] != 0 && t->cases[k] != c) {
+        k = (k + 1) & t->masque;
+    }
+    return k;
+}
+
+/**
+ * @brief Fait avancer tous les serpents d'une salle d'une case, en même temps.
+ * @param r Salle.
+ *
+ * Même règle que progresser() pour chaque serpent (la queue libère sa
+ * case avant le test de collision), étendue aux autres serpents :
+ * 1. chaque serpent prend sa prochaine touche valide et vise une case ;
+ * 2. les queues des serpents qui ne grandissent pas sont retirées ;
+ * 3. une tête meurt dans une bordure, un pavé, un serpent,
+ *    ou si une autre tête vise la même case ;
+ * chaque tête ne coûte qu'une lecture du plateau et de la table des
+ * têtes, quelle que soit la longueur des serpents.
+ * 4. les survivants avancent, les morts disparaissent du plateau.
+ */
+void avancerTick(Salle *r) {
+    Partie *m = &r->monde;
+    TableTetes *tetes = &r->tetes;
+    memset(tetes->nb, 0, tetes->masque + 1);
+    r->tick++;
+
+    for (int i = 0; i < r->capacite; i++) {
+        Joueur *j = r->joueurs[i];
+        if (j == NULL) continue;
+        if (!j->vivant) {
+            if (j->attente > 0) j->attente--;
+            else faireRepartir(r, j);
+            /** un serpent qui repart fait son premier pas dans ce tick */
+            if (!j->vivant) continue;
+        }
+        /** touches refusées (demi-tour) jetées, comme au clavier */
+        while (j->debutFile != j->finFile) {
+            char touche = j->file[j->debutFile++ % TAILLEFILE];
+            j->touchesTraitees++;
+            if (directionValide(touche, j->direction)) {
+                j->direction = touche;
+                break;
+            }
+        }
+        j->cible = redirection[segment(j, 0) + DELTA[(unsigned char)j->direction]];
+        int k = placeTete(tetes, j->cible);
+        tetes->cases[k] = j->cible;
+        tetes->nb[k]++;
+    }
+
+    for (int i = 0; i < r->capacite; i++) {
+        Joueur *j = r->joueurs[i];
+        if (j == NULL || !j->vivant) continue;
+        if (j->aGrandir == 0 && CASEPLATEAU(m, j->cible) != POMME) {
+            CASEPLATEAU(m, segment(j, j->taille - 1)) = VIDE;
+            j->taille--;
+        }
+    }
+
+    for (int i = 0; i < r->capacite; i++) {
+        Joueur *j = r->joueurs[i];
+        if (j == NULL || !j->vivant) continue;
+        char v = CASEPLATEAU(m, j->cible);
+        /** le plateau donne les corps (queues déjà retirées) et les têtes
+         * qui s'échangent leurs cases ; la table, deux têtes dans la
+         * même case : toutes meurent */
+        bool collision = v == CARBORDURE || v == CORPS || v == TETE ||
+            tetes->nb[placeTete(tetes, j->cible)] > 1;
+        if (collision) {
+            j->attente = -1;
+        }
+    }
+
+    for (int i = 0; i < r->capacite; i++) {
+        Joueur *j = r->joueurs[i];
+        if (j == NULL || !j->vivant) continue;
+        if (j->attente < 0) {
+            effacerSerpent(r, j);
+            j->attente = DELAIRETOUR;
+            j->morts++;
+            continue;
+        }
+        if (CASEPLATEAU(m, j->cible) == POMME) {
+            j->aGrandir++;
+            j->pommes++;
+            r->nbPommes--;
+        }
+        CASEPLATEAU(m, segment(j, 0)) = CORPS;
+        j->tete = (j->tete + MAXSEGMENTS - 1) % MAXSEGMENTS;
+        j->corps[j->tete] = j->cible;
+        CASEPLATEAU(m, j->cible) = TETE;
+        j->taille++;
+        if (j->aGrandir > 0) {
+            j->aGrandir--;
+            /** au-delà de MAXSEGMENTS, le serpent ne grandit plus */
+            if (j->taille >= MAXSEGMENTS) {
+                CASEPLATEAU(m, segment(j, j->taille - 1)) = VIDE;
+                j->taille--;
+            }
+        }
+    }
+
+    while (r->nbPommes < r->maxPommes && ajouterPommeSalle(r)) {
+    }
+}
+
+/**
+ * @brief Écrit un entier de 16 bits, octet de poids faible en premier.
+ */
+static unsigned char *ecrire16(unsigned char *o, uint32_t v) {
+    o[0] = v & 0xFF;
+    o[1] = (v >> 8) & 0xFF;
+    return o + 2;
+}
+
+/**
+ * @brief Envoie à chaque joueur d'une salle l'état de son serpent.
+ * @param r Salle.
+ *
+ * Message ETAT : type, numéro du tick (32 bits), vivant, tête x et y,
+ * taille (16 bits chacun), puis le nombre de touches traitées modulo
+ * 256 (accusé de réception des touches), entiers en petit-boutiste.
+ */
+void diffuserEtats(Salle *r) {
+    for (int i = 0; i < r->capacite; i++) {
+        Joueur *j = r->joueurs[i];
+        if (j == NULL) continue;
+        unsigned char message[TAILLEETAT];
+        unsigned char *o = message;
+        *o++ = ETAT;
+        o = ecrire16(o, r->tick & 0xFFFF);
+        o = ecrire16(o, r->tick >> 16);
+        *o++ = j->vivant;
+        o = ecrire16(o, j->vivant ? CASEX(segment(j, 0)) : 0);
+        o = ecrire16(o, j->vivant ? CASEY(segment(j, 0)) : 0);
+        o = ecrire16(o, j->vivant ? j->taille : 0);
+        *o++ = j->touchesTraitees & 0xFF;
+        envoyer(j, message, TAILLEETAT);
+    }
+}
+
+/**
+ * @brief Affiche le bilan de la dernière période, écrit les métriques
+ * par salle et rééquilibre les fils.
+ * @param s Serveur.
+ */
+void faireBilan(Serveur *s) {
+    long charges[MAXTRAVAILLEURS];
+    long retardMax = 0, dureeMax = 0, manques = 0, cessions = 0, perdus = 0;
+    long pireSalle = 0, cumul = 0, ticks = 0;
+    long appels = atomic_exchange(&s->appels, 0);
+    for (int i = 0; i < s->nbTravailleurs; i++) {
+        Travailleur *t = &s->travailleurs[i];
+        charges[i] = atomic_exchange(&t->charge, 0);
+        appels += atomic_exchange(&t->appels, 0);
+        long r = atomic_exchange(&t->retardMax, 0);
+        long d = atomic_exchange(&t->dureeMax, 0);
+        if (r > retardMax) retardMax = r;
+        if (d > dureeMax) dureeMax = d;
+        manques += atomic_load(&t->ticksManques);
+        cessions += atomic_load(&t->cessions);
+    }
+
+    FILE *fichier = NULL;
+    char provisoire[4096];
+    if (s->metriques != NULL) {
+        snprintf(provisoire, sizeof(provisoire), "%s.tmp", s->metriques);
+        fichier = fopen(provisoire, "w");
+    }
+    if (fichier != NULL) {
+        fprintf(fichier, "# salle fil joueurs ticks dernier_us moyen_us max_us messages_perdus\n");
+    }
+    for (int i = 0; i < s->nbSalles; i++) {
+        Salle *r = s->salles[i];
+        long max = atomic_exchange(&r->dureeMax, 0);
+        long total = atomic_load(&r->dureeCumul);
+        long n = atomic_load(&r->ticks);
+        long p = atomic_load(&r->messagesPerdus);
+        if (max > pireSalle) pireSalle = max;
+        cumul += total;
+        ticks += n;
+        perdus += p;
+        if (fichier != NULL) {
+            fprintf(fichier, "%d %d %d %ld %.1f %.1f %.1f %ld\n", r->numero,
+                    atomic_load(&r->travailleur), atomic_load(&r->places), n,
+                    atomic_load(&r->dureeDernier) / 1000.0,
+                    n > 0 ? total / 1000.0 / n : 0.0, max / 1000.0, p);
+        }
+    }
+    if (fichier != NULL) {
+        fclose(fichier);
+        rename(provisoire, s->metriques);
+    }
+
+    printf("bilan : %d salles, %d joueurs, tick de salle moyen %.1f µs (max %.1f), "
+           "tick de fil max %ld µs, retard max %ld µs, %ld ticks manqués, "
+           "%ld messages perdus, %ld cessions, %ld appels réseau, charge des fils (ms/s) :",
+           s->nbSalles, atomic_load(&s->nbConnectes), ticks > 0 ? cumul / 1000.0 / ticks : 0.0,
+           pireSalle / 1000.0, dureeMax, retardMax, manques, perdus, cessions, appels);
+    for (int i = 0; i < s->nbTravailleurs; i++) {
+        printf(" %ld", charges[i] / 1000000);
+    }
+    printf("\n");
+    fflush(stdout);
+
+    equilibrer(s, charges);
+}
+
+/**
+ * @brief Demande au fil le plus chargé de céder une salle au moins chargé.
+ * @param s Serveur.
+ * @param charges Temps passé en ticks par chaque fil pendant la période (ns).
+ *
+ * Une seule salle change de fil par bilan, et seulement si l'écart
+ * dépasse DESEQUILIBRE % : la salle cédée coûte au plus la moitié de
+ * l'écart, pour ne pas inverser le déséquilibre.
+ */
+void equilibrer(Serveur *s, const long charges[]) {
+    int plus = 0, moins = 0;
+    for (int i = 1; i < s->nbTravailleurs; i++) {
+        if (charges[i] > charges[plus]) plus = i;
+        if (charges[i] < charges[moins]) moins = i;
+    }
+    long ecart = charges[plus] - charges[moins];
+    if (plus == moins || ecart * 100 <= charges[moins] * DESEQUILIBRE) return;
+    long ticksParBilan = PERIODEBILAN / s->periode;
+    if (ticksParBilan < 1) ticksParBilan = 1;
+    long budget = ecart / 2 / ticksParBilan;
+    if (budget > INT32_MAX) budget = INT32_MAX;
+    posterMessage(&s->travailleurs[plus],
+                  (Message){.type = MSG_CEDER, .destination = moins, .budget = budget});
+}
+
+/*****************************************************
+*          MOTEURS D'ENTREES-SORTIES                 *
+*****************************************************/
+
+/**
+ * @brief Vérifie que le noyau connaît les opérations io_uring du serveur.
+ * @param fd Descripteur de l'anneau.
+ * @return false s'il en manque une, ou si le noyau ne sait pas sonder.
+ *
+ * Les drapeaux ne se sondent pas : l'acceptation multiple et les
+ * annulations par descripteur (IORING_ASYNC_CANCEL_FD | ALL) datent
+ * de Linux 5.19, comme IORING_OP_SOCKET, qui sert de témoin ; les
+ * attentes multiples (IORING_POLL_ADD_MULTI) sont plus anciennes.
+ */
+static bool sonderAnneau(int fd) {
+    static const int requises[] = {
+        IORING_OP_ACCEPT, IORING_OP_POLL_ADD, IORING_OP_READ_FIXED,
+        IORING_OP_WRITE_FIXED, IORING_OP_ASYNC_CANCEL, IORING_OP_SOCKET
+    };
+    size_t taille = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *sonde = calloc(1, taille);
+    if (sonde == NULL) return false;
+    bool pret = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, sonde, 256) == 0;
+    for (size_t i = 0; i < sizeof(requises) / sizeof(requises[0]) && pret; i++) {
+        pret = requises[i] <= sonde->last_op &&
+               (sonde->ops[requises[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(sonde);
+    return pret;
+}
+
+/**
+ * @brief Ouvre un anneau io_uring et le projette en mémoire.
+ * @param a Anneau.
+ * @param entrees Taille de la file de soumission (puissance de 2).
+ * @param appels Compteur des appels système de l'anneau.
+ * @return 0, ou -1 si io_uring est indisponible ou trop ancien
+ * (errno renseigné).
+ *
+ * La file des complétions est quatre fois plus grande que celle des
+ * soumissions ; au-delà, le noyau garde les complétions en réserve
+ * (IORING_FEAT_NODROP) au lieu de les perdre. Les opérations du
+ * serveur sont sondées (IORING_REGISTER_PROBE) avant tout usage.
+ */
+int ouvrirAnneau(Anneau *a, unsigned entrees, _Atomic long *appels) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = entrees * 4;
+    a->fd = syscall(__NR_io_uring_setup, entrees, &p);
+    if (a->fd < 0) return -1;
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_NODROP)) {
+        close(a->fd);
+        a->fd = -1;
+        errno = ENOSYS;
+        return -1;
+    }
+    if (!sonderAnneau(a->fd)) {
+        close(a->fd);
+        a->fd = -1;
+        errno = ENOSYS;
+        return -1;
+    }
+    size_t taille = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t tailleCq = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (tailleCq > taille) taille = tailleCq;
+    char *anneaux = mmap(NULL, taille, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         a->fd, IORING_OFF_SQ_RING);
+    a->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, a->fd, IORING_OFF_SQES);
+    if (anneaux == MAP_FAILED || a->sqes == MAP_FAILED) {
+        /** la projection réussie, s'il y en a une, est rendue */
+        int erreur = errno;
+        if (anneaux != MAP_FAILED) munmap(anneaux, taille);
+        if (a->sqes != MAP_FAILED) munmap(a->sqes, p.sq_entries * sizeof(struct io_uring_sqe));
+        errno = erreur;
+        close(a->fd);
+        a->fd = -1;
+        return -1;
+    }
+    a->sqTete = (unsigned *)(anneaux + p.sq_off.head);
+    a->sqQueue = (unsigned *)(anneaux + p.sq_off.tail);
+    a->sqMasque = *(unsigned *)(anneaux + p.sq_off.ring_mask);
+    a->entrees = p.sq_entries;
+    /** la case i du tableau désigne toujours l'entrée i */
+    unsigned *tableau = (unsigned *)(anneaux + p.sq_off.array);
+    for (unsigned i = 0; i < p.sq_entries; i++) {
+        tableau[i] = i;
+    }
+    a->cqTete = (unsigned *)(anneaux + p.cq_off.head);
+    a->cqQueue = (unsigned *)(anneaux + p.cq_off.tail);
+    a->cqMasque = *(unsigned *)(anneaux + p.cq_off.ring_mask);
+    a->cqes = (struct io_uring_cqe *)(anneaux + p.cq_off.cqes);
+    a->queue = *a->sqQueue;
+    a->aSoumettre = 0;
+    a->appels = appels;
+    return 0;
+}
+
+/**
+ * @brief Enregistre la zone des casiers auprès d'un anneau.
+ * @param a Anneau.
+ * @return false en cas d'échec.
+ *
+ * Toute la zone forme le tampon 0 : lectures et écritures des
+ * connexions s'y font sans que le noyau ait à épingler les pages
+ * à chaque opération.
+ */
+bool enregistrerCasiers(Anneau *a) {
+    struct iovec zone = {serveur.casiers, (size_t)serveur.nbCasiers * sizeof(Casier)};
+    return syscall(__NR_io_uring_register, a->fd, IORING_REGISTER_BUFFERS, &zone, 1) == 0;
+}
+
+/**
+ * @brief Réserve une entrée de soumission, remise à zéro.
+ * @param a Anneau.
+ * @return L'entrée, à remplir avant la prochaine soumission.
+ *
+ * Quand la file est pleine, elle est soumise sans attendre.
+ */
+struct io_uring_sqe *entreeLibre(Anneau *a) {
+    while (a->queue - __atomic_load_n(a->sqTete, __ATOMIC_ACQUIRE) >= a->entrees) {
+        soumettreAnneau(a, 0);
+    }
+    struct io_uring_sqe *e = &a->sqes[a->queue & a->sqMasque];
+    memset(e, 0, sizeof(*e));
+    a->queue++;
+    a->aSoumettre++;
+    return e;
+}
+
+/**
+ * @brief Soumet les entrées préparées et attend des complétions,
+ * en un seul appel système.
+ * @param a Anneau.
+ * @param attendre Complétions à attendre (0 : aucune).
+ * @return Nombre d'entrées soumises, ou -1 (errno renseigné).
+ */
+int soumettreAnneau(Anneau *a, unsigned attendre) {
+    __atomic_store_n(a->sqQueue, a->queue, __ATOMIC_RELEASE);
+    int n = syscall(__NR_io_uring_enter, a->fd, a->aSoumettre, attendre,
+                    attendre > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    atomic_fetch_add_explicit(a->appels, 1, memory_order_relaxed);
+    if (n > 0) a->aSoumettre -= n;
+    return n;
+}
+
+/**
+ * @brief Attend et traite les événements d'un fil (epoll).
+ * @param t Fil.
+ */
+void attendreEpoll(Travailleur *t) {
+    struct epoll_event evenements[256];
+    int n = epoll_wait(t->epoll, evenements, 256, 100);
+    atomic_fetch_add_explicit(&t->appels, 1, memory_order_relaxed);
+    bool messages = false;
+    for (int k = 0; k < n; k++) {
+        void *cible = evenements[k].data.ptr;
+        if (cible == NULL) {
+            uint64_t expirations;
+            if (read(t->minuterie, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+                jouerTicks(t, expirations);
+            }
+        } else if (cible == t) {
+            /** après les autres événements : une salle cédée emporte ses joueurs */
+            messages = true;
+        } else {
+            lireJoueur(cible);
+        }
+    }
+    if (messages) lireMessages(t);
+}
+
+/**
+ * @brief Soumet le travail préparé, attend et traite les complétions
+ * d'un fil (io_uring).
+ * @param t Fil.
+ *
+ * Les écritures d'un tick et les lectures relancées s'accumulent sur
+ * l'anneau pendant le traitement et partent toutes au tour suivant,
+ * avec l'attente, en un seul appel.
+ */
+void attendreAnneau(Travailleur *t) {
+    Anneau *a = &t->anneau;
+    if (soumettreAnneau(a, 1) < 0 && errno != EINTR && errno != EBUSY && errno != EAGAIN) {
+        perror("io_uring_enter");
+        arretDemande = 1;
+        return;
+    }
+    bool messages = false;
+    unsigned tete = *a->cqTete;
+    while (tete != __atomic_load_n(a->cqQueue, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe *c = &a->cqes[tete & a->cqMasque];
+        uint64_t donnee = c->user_data;
+        int resultat = c->res;
+        unsigned drapeaux = c->flags;
+        /** la case est rendue avant le traitement, qui peut soumettre */
+        __atomic_store_n(a->cqTete, ++tete, __ATOMIC_RELEASE);
+        traiterCompletion(t, donnee, resultat, drapeaux, &messages);
+    }
+    if (messages) lireMessages(t);
+    verifierPartantes(t);
+}
+
+/**
+ * @brief Traite une complétion de l'anneau d'un fil.
+ * @param t Fil.
+ * @param donnee user_data de l'opération : sa nature et son joueur.
+ * @param resultat Résultat de l'opération (négatif : -errno).
+ * @param drapeaux Drapeaux de la complétion.
+ * @param messages Mis à true quand le tube des messages est prêt.
+ *
+ * Un joueur fermé n'est libéré qu'à la fin de sa dernière opération ;
+ * un joueur partant ne relance rien, sa salle attend de changer de fil.
+ */
+void traiterCompletion(Travailleur *t, uint64_t donnee, int resultat, unsigned drapeaux, bool *messages) {
+    Joueur *j = (Joueur *)(uintptr_t)(donnee & ~(uint64_t)MASQUEOPERATION);
+    Operation op = donnee & MASQUEOPERATION;
+    if (op == OP_MINUTERIE) {
+        uint64_t expirations;
+        if (read(t->minuterie, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+            jouerTicks(t, expirations);
+        }
+    }
+    if (op == OP_BOITE) *messages = true;
+    if (op == OP_MINUTERIE || op == OP_BOITE) {
+        /** attente multiple terminée par le noyau : la relancer */
+        if (!(drapeaux & IORING_CQE_F_MORE)) {
+            struct io_uring_sqe *e = entreeLibre(&t->anneau);
+            e->opcode = IORING_OP_POLL_ADD;
+            e->fd = op == OP_MINUTERIE ? t->minuterie : t->boite[0];
+            e->poll32_events = POLLIN;
+            e->len = IORING_POLL_ADD_MULTI;
+            e->user_data = op;
+        }
+        return;
+    }
+    if (j == NULL) return;
+
+    j->operations--;
+    if (j->ferme) {
+        if (j->operations == 0) {
+            close(j->fd);
+            free(j);
+        }
+        return;
+    }
+    if (op == OP_LECTURE) {
+        if (resultat > 0) {
+            if (recevoirTouches(j, j->casier->entree, resultat) && !j->partant) lancerLecture(t, j);
+        } else if (resultat == -EINTR || resultat == -EAGAIN) {
+            if (!j->partant) lancerLecture(t, j);
+        } else if (resultat != -ECANCELED) {
+            deconnecter(j);
+        }
+        return;
+    }
+    /** écriture : ce qui n'est pas parti reste en tête de la sortie */
+    j->enVol = 0;
+    if (resultat == -ECANCELED) return;
+    if (resultat <= 0) {
+        deconnecter(j);
+        return;
+    }
+    memmove(j->casier->sortie, j->casier->sortie + resultat, j->aEnvoyer - resultat);
+    j->aEnvoyer -= resultat;
+    if (j->aEnvoyer > 0 && !j->partant) lancerEcriture(t, j);
+}
+
+/**
+ * @brief Prépare la lecture des touches d'un joueur dans son casier.
+ * @param t Fil propriétaire.
+ * @param j Joueur.
+ */
+void lancerLecture(Travailleur *t, Joueur *j) {
+    struct io_uring_sqe *e = entreeLibre(&t->anneau);
+    e->opcode = IORING_OP_READ_FIXED;
+    e->fd = j->fd;
+    e->addr = (uintptr_t)j->casier->entree;
+    e->len = TAILLEENTREE;
+    e->buf_index = 0;
+    e->user_data = (uintptr_t)j | OP_LECTURE;
+    j->operations++;
+}
+
+/**
+ * @brief Prépare l'envoi de la sortie d'un joueur depuis son casier.
+ * @param t Fil propriétaire.
+ * @param j Joueur, sans écriture en cours.
+ *
+ * Les messages suivants s'ajoutent derrière les octets en vol,
+ * qui ne bougent pas avant la complétion.
+ */
+void lancerEcriture(Travailleur *t, Joueur *j) {
+    struct io_uring_sqe *e = entreeLibre(&t->anneau);
+    e->opcode = IORING_OP_WRITE_FIXED;
+    e->fd = j->fd;
+    e->addr = (uintptr_t)j->casier->sortie;
+    e->len = j->aEnvoyer;
+    e->buf_index = 0;
+    e->user_data = (uintptr_t)j | OP_ECRITURE;
+    j->enVol = j->aEnvoyer;
+    j->operations++;
+}
+
+/**
+ * @brief Annule toutes les opérations d'un joueur sur l'anneau d'un fil.
+ */
+static void annulerOperations(Travailleur *t, Joueur *j) {
+    struct io_uring_sqe *e = entreeLibre(&t->anneau);
+    e->opcode = IORING_OP_ASYNC_CANCEL;
+    e->fd = j->fd;
+    e->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    e->user_data = OP_ANNULATION;
+}
+
+/**
+ * @brief Fait suivre une connexion par la boucle d'un fil.
+ * @param t Fil.
+ * @param j Joueur arrivé ou venu avec sa salle.
+ */
+void suivreConnexion(Travailleur *t, Joueur *j) {
+    if (serveur.moteur == MOTEUR_URING) {
+        j->partant = false;
+        lancerLecture(t, j);
+        if (j->aEnvoyer > 0) lancerEcriture(t, j);
+        return;
+    }
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = j};
+    epoll_ctl(t->epoll, EPOLL_CTL_ADD, j->fd, &ev);
+}
+
+/**
+ * @brief Retire une connexion de la boucle d'un fil, avant que sa
+ * salle ne change de fil.
+ * @param t Fil.
+ * @param j Joueur.
+ */
+void oublierConnexion(Travailleur *t, Joueur *j) {
+    if (serveur.moteur == MOTEUR_URING) {
+        j->partant = true;
+        if (j->operations > 0) annulerOperations(t, j);
+        return;
+    }
+    epoll_ctl(t->epoll, EPOLL_CTL_DEL, j->fd, NULL);
+}
+
+/**
+ * @brief Ferme la connexion d'un joueur déjà retiré de sa salle.
+ * @param t Fil propriétaire.
+ * @param j Joueur.
+ *
+ * Avec io_uring, la socket et le joueur survivent à leurs opérations
+ * en cours : elles sont annulées, et la dernière complétion les libère.
+ */
+void fermerConnexion(Travailleur *t, Joueur *j) {
+    if (serveur.moteur == MOTEUR_URING && t->anneau.fd >= 0 && j->operations > 0) {
+        j->ferme = true;
+        annulerOperations(t, j);
+        return;
+    }
+    close(j->fd);
+    free(j);
+}
+
+/**
+ * @brief Envoie à leur nouveau fil les salles cédées dont les
+ * joueurs n'ont plus d'opération en cours.
+ * @param t Fil.
+ */
+void verifierPartantes(Travailleur *t) {
+    for (int i = 0; i < t->nbPartantes; i++) {
+        Salle *r = t->partantes[i];
+        bool prete = true;
+        for (int k = 0; k < r->capacite && prete; k++) {
+            if (r->joueurs[k] != NULL && r->joueurs[k]->operations > 0) prete = false;
+        }
+        if (!prete) continue;
+        t->partantes[i--] = t->partantes[--t->nbPartantes];
+        posterMessage(&serveur.travailleurs[r->destination], (Message){.type = MSG_SALLE, .salle = r->numero});
+    }
+}
+
+/**
+ * @brief Boucle du fil principal avec io_uring : acceptations
+ * multiples et bilans.
+ * @param s Serveur.
+ *
+ * Une seule demande d'acceptation rend une complétion par connexion ;
+ * toutes celles arrivées pendant un tour sont traitées ensemble.
+ * Une acceptation refusée par le noyau (-EINVAL) ne serait jamais
+ * acceptée : le serveur s'arrête au lieu de la relancer sans fin.
+ * Faute de descripteur (-EMFILE, -ENFILE), elle n'est relancée
+ * qu'au prochain bilan, comme avec epoll.
+ * @return false si la boucle s'est arrêtée sur une erreur.
+ */
+bool accueillirAnneau(Serveur *s) {
+    Anneau *a = &s->anneau;
+    bool acceptation = false, minuterie = false;
+    while (!arretDemande) {
+        if (!acceptation && !s->suspendu) {
+            struct io_uring_sqe *e = entreeLibre(a);
+            e->opcode = IORING_OP_ACCEPT;
+            e->fd = s->ecoute;
+            e->ioprio = IORING_ACCEPT_MULTISHOT;
+            e->user_data = OP_ACCEPTATION;
+            acceptation = true;
+        }
+        if (!minuterie) {
+            struct io_uring_sqe *e = entreeLibre(a);
+            e->opcode = IORING_OP_POLL_ADD;
+            e->fd = s->minuterie;
+            e->poll32_events = POLLIN;
+            e->len = IORING_POLL_ADD_MULTI;
+            e->user_data = OP_MINUTERIE;
+            minuterie = true;
+        }
+        if (soumettreAnneau(a, 1) < 0 && errno != EINTR && errno != EBUSY && errno != EAGAIN) {
+            perror("io_uring_enter");
+            arretDemande = 1;
+            return false;
+        }
+        unsigned tete = *a->cqTete;
+        while (tete != __atomic_load_n(a->cqQueue, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe *c = &a->cqes[tete & a->cqMasque];
+            uint64_t donnee = c->user_data;
+            int resultat = c->res;
+            bool encore = c->flags & IORING_CQE_F_MORE;
+            __atomic_store_n(a->cqTete, ++tete, __ATOMIC_RELEASE);
+            if (donnee == OP_ACCEPTATION) {
+                if (resultat == -EINVAL) {
+                    errno = EINVAL;
+                    perror("io_uring, acceptation");
+                    arretDemande = 1;
+                    return false;
+                }
+                if (resultat == -EMFILE || resultat == -ENFILE) {
+                    errno = -resultat;
+                    perror("io_uring, acceptation");
+                    s->suspendu = true;
+                }
+                if (resultat >= 0) placerJoueur(s, resultat);
+                acceptation = encore;
+            } else {
+                uint64_t expirations;
+                if (read(s->minuterie, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+                    faireBilan(s);
+                }
+                s->suspendu = false;
+                minuterie = encore;
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,157 @@
+/**
+ * @file test-flux.c
+ * @brief Vérifications du flux de spectateurs (--diffuser, --relire).
+ * @author Arthur CHAUVEL
+ * @version 1.0
+ * @date 24/11/24
+ *
+ * Des parties complètes, jouées par l'autopilote ou au hasard jusqu'à
+ * la collision, sont encodées tick par tick puis décodées : la partie
+ * reconstruite doit rester identique. Des images clés et des deltas
+ * abîmés (portail hors du plateau, serpent ou pomme dans une bordure,
+ * pas depuis une tête sortie du plateau) doivent être refusés sans
+ * modifier la partie.
+ *
+ * Compilation : gcc test-flux.c -o test-flux -pthread -lm
+ * Usage : ./test-flux (code de retour non nul en cas d'échec)
+ */
+
+#define SERPENT_SANS_MAIN
+#include "version4-pave-aleatoire.c"
+
+/** Ticks joués au plus par partie. */
+const int MAXTICKSTEST = 5000;
+/** Ticks entre deux images clés des parties rejouées. */
+const int INTERVALLETEST = 7;
+
+/** @brief Nombre de vérifications échouées. */
+int echecs = 0;
+
+/**
+ * @brief Compte et signale une vérification échouée.
+ * @param ok Résultat de la vérification.
+ * @param quoi Description.
+ */
+void verifier(bool ok, const char *quoi) {
+    if (!ok) {
+        printf("ÉCHEC : %s\n", quoi);
+        echecs++;
+    }
+}
+
+/**
+ * @brief Indique si deux parties montrent la même position.
+ */
+bool memePosition(const Partie *a, const Partie *b) {
+    if (memcmp(a->plateau, b->plateau, sizeof(a->plateau)) != 0 ||
+        a->tailleSerpent != b->tailleSerpent || a->posPomme != b->posPomme ||
+        a->pommesMangees != b->pommesMangees || a->direction != b->direction) {
+        return false;
+    }
+    for (int i = 0; i < a->tailleSerpent; i++) {
+        if (SEGMENT(a, i) != SEGMENT(b, i)) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Joue une partie en la diffusant, et la reconstruit
+ * à partir du flux à chaque tick.
+ * @param graine Graine de la partie.
+ * @param autopilote Vrai pour l'autopilote, faux pour des virages au hasard.
+ */
+void rejouerPartie(uint64_t graine, bool autopilote) {
+    static Partie p, relue;
+    static Flux f;
+    char quoi[64];
+    snprintf(quoi, sizeof(quoi), "partie %llu rejouée", (unsigned long long)graine);
+    initPortails();
+    initPartie(&p, graine);
+    relue.tailleSerpent = 0;
+    initFlux(&f, INTERVALLETEST);
+    int n = encoderImageCle(&f, &p);
+    bool ok = decoderFlux(&relue, f.message, n) == n && memePosition(&p, &relue);
+    bool collision = false, pommeMangee;
+    for (int tick = 0; ok && !collision && tick < MAXTICKSTEST; tick++) {
+        char touche = autopilote ? decisionAutopilote(&p) : DIRECTIONSFLUX[aleatoire(&p) % 4];
+        if (directionValide(touche, p.direction)) p.direction = touche;
+        progresser(&p, &collision, &pommeMangee);
+        if (pommeMangee && !mangerPomme(&p)) break;
+        n = encoderTick(&f, &p);
+        ok = decoderFlux(&relue, f.message, n) == n && memePosition(&p, &relue);
+    }
+    verifier(ok, quoi);
+}
+
+/**
+ * @brief Décode un message qui doit être refusé, et vérifie que
+ * la partie n'a pas changé.
+ * @param relue Partie déjà reçue.
+ * @param message Message abîmé.
+ * @param n Taille du message.
+ * @param quoi Description.
+ */
+void verifierRefus(Partie *relue, const uint8_t *message, int n, const char *quoi) {
+    static Partie avant;
+    copierPartie(&avant, relue);
+    verifier(decoderFlux(relue, message, n) == -1 && memePosition(&avant, relue), quoi);
+}
+
+/**
+ * @brief Fabrique des images clés et des deltas abîmés.
+ */
+void verifierMessagesAbimes() {
+    static Partie p, abimee, relue;
+    static Flux f;
+    initPortails();
+    initPartie(&p, 1);
+    initFlux(&f, INTERVALLETEST);
+    int n = encoderImageCle(&f, &p);
+    verifier(decoderFlux(&relue, f.message, n) == n, "image clé valide");
+
+    /** entrée de portail sous la dernière ligne du plateau */
+    Case entree = entreesPortails[0];
+    entreesPortails[0] = CASE(3, HAUTEURMAX);
+    n = encoderImageCle(&f, &p);
+    entreesPortails[0] = entree;
+    verifierRefus(&relue, f.message, n, "portail hors du plateau");
+
+    /** entrée de portail dans la colonne de fin de ligne */
+    entreesPortails[0] = CASE(LARGEURMAX, 3);
+    n = encoderImageCle(&f, &p);
+    entreesPortails[0] = entree;
+    verifierRefus(&relue, f.message, n, "portail dans la colonne de fin");
+
+    copierPartie(&abimee, &p);
+    SEGMENT(&abimee, 1) = CASE(0, 5);
+    n = encoderImageCle(&f, &abimee);
+    verifierRefus(&relue, f.message, n, "corps dans une bordure");
+
+    copierPartie(&abimee, &p);
+    abimee.posPomme = CASE(LARGEURMAX, 3);
+    n = encoderImageCle(&f, &abimee);
+    verifierRefus(&relue, f.message, n, "pomme hors du plateau");
+
+    /** tête dans une bordure : image acceptée (tick de la collision),
+     * mais aucun pas ne peut en partir */
+    copierPartie(&abimee, &p);
+    SEGMENT(&abimee, 0) = CASE(0, HAUTEURMAX / 2 + 3);
+    n = encoderImageCle(&f, &abimee);
+    verifier(decoderFlux(&relue, f.message, n) == n, "image clé de la collision");
+    uint8_t delta = DELTAFLUX | DELTAQUEUE | codeDirection(GAUCHE);
+    verifierRefus(&relue, &delta, 1, "pas depuis une tête dans une bordure");
+}
+
+int main() {
+    initZobrist();
+    initAutopilote();
+    for (uint64_t graine = 1; graine <= 3; graine++) {
+        rejouerPartie(graine, true);
+    }
+    for (uint64_t graine = 4; graine <= 20; graine++) {
+        rejouerPartie(graine, false);
+    }
+    verifierMessagesAbimes();
+    printf("%s (%d échecs)\n", echecs == 0 ? "Flux vérifié" : "Flux incorrect", echecs);
+    return echecs == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
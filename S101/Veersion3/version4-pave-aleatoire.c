@@ -14,6 +14,9 @@
  * Le jeu se termine en cas de collision, de victoire
  * (toutes les pommes mangées),
  * ou si le joueur déclare forfait.
+ *
+ * Compilation : gcc version4-pave-aleatoire.c -o version4-pave-aleatoire -pthread -lm
+ * (ajouter -mavx2 ou -march=native pour l'encodeur d'observations AVX2)
  */
 
 #include <stdio.h>
@@ -23,6 +26,23 @@
 #include <time.h>
 #include <termios.h>
 #include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "protocole.h"
 
 /*****************************************************
 *DEFINITIONS CONSANTES/ VARIABLES GLOBALES/ FONCTIONS*
@@ -31,10 +51,20 @@
 
 /** @brief Définition des constantes. */
 
-/** Largeur maximale du plateau de jeu. */
-#define LARGEURMAX 80
-/** Hauteur maximale du plateau de jeu. */
-#define HAUTEURMAX 40
+/* LARGEURMAX, HAUTEURMAX, les touches de direction, ARRET et
+ * directionValide viennent de protocole.h. */
+/** Longueur d'une ligne du tableau plateau (colonne de fin comprise). */
+#define LARGEURLIGNE (LARGEURMAX + 1)
+/** Nombre de cases du plateau vu comme un tableau à une dimension. */
+#define NBCASES ((HAUTEURMAX + 1) * LARGEURLIGNE)
+/** Indice linéaire de la case de coordonnées (x, y). */
+#define CASE(x, y) ((y) * LARGEURLIGNE + (x))
+/** Coordonnée X d'un indice linéaire. */
+#define CASEX(c) ((c) % LARGEURLIGNE)
+/** Coordonnée Y d'un indice linéaire. */
+#define CASEY(c) ((c) / LARGEURLIGNE)
+/** Accès au plateau d'une partie par indice linéaire. */
+#define CASEPLATEAU(p, c) (((char *)(p)->plateau)[c])
 /** Coordonnée minimale utilisée sur le plateau. */
 const int COORDMIN = 1; 
 /** Taille initiale du serpent. */
@@ -43,6 +73,12 @@ const int TAILLESERPENT = 10;
 const int NBREPAVE = 4; 
 /** Taille d'un pavé d'obstacle. */
 const int TAILLEPAVE = 5; 
+/** Nombre de tirages au-delà duquel on renonce à placer un pavé
+ * (plateau presque rempli par le serpent). */
+const int MAXESSAISPAVE = 10000; 
+/** Tirages de pavés qui coupent le plateau au-delà desquels
+ * on en place un de moins. */
+const int MAXTIRAGESPAVES = 100;
 /** Temps de pause entre deux déplacements */
 const int TEMPORISATION = 200000; 
 /** Nombre de pommes à manger pour gagner. */
@@ -61,122 +97,922 @@ const int STARTSAFEZONEY = 12;
 const int ENDSAFEZONEY = 23;
 /** Augmentation de la vitesse après avoir mangé une pomme. */
 const int AUGMENTATIONVITESSE = 15000; 
-/** Taille maximale que le serpent peut atteindre. */
-#define MAXTAILLESERPENT 100 
+/** Temporisation minimale, atteinte au bout de quelques pommes. */
+const int TEMPORISATIONMIN = 20000; 
+/** Taille maximale que le serpent peut atteindre (tout le plateau). */
+#define MAXTAILLESERPENT NBCASES
 /** Caractère représentant la tête du serpent. */
 const char TETE = 'O'; 
 /** Caractère représentant le corps du serpent. */
 const char CORPS = 'X'; 
 /** Caractère représentant une pomme. */
 const char POMME = '6'; 
-/** Caractère permettant d'arrêter le jeu. */
-const char ARRET = 'a'; 
-/** Direction : droite. */
-const char DROITE = 'd'; 
-/** Direction : gauche. */
-const char GAUCHE = 'q'; 
-/** Direction : haut. */
-const char HAUT = 'z'; 
-/** Direction : bas. */
-const char BAS = 's'; 
+/** Caractère permettant de revenir quelques déplacements en arrière. */
+const char RETOUR = 'r';
 /** Caractère représentant une case vide. */
 const char VIDE = ' '; 
 /** Caractère représentant une bordure ou un obstacle. */
 const char CARBORDURE = '#'; 
 
-/** @brief Plateau de jeu. */
-char plateau[HAUTEURMAX +1][LARGEURMAX +1];
+/** @brief Indice linéaire d'une case : 16 bits suffisent pour 80x40. */
+#if NBCASES <= 65536
+typedef uint16_t Case;
+#else
+typedef uint32_t Case;
+#endif
+
+/** Décalage d'indice pour chaque touche de direction
+ * (doit rester cohérent avec DROITE, GAUCHE, HAUT et BAS). */
+const int DELTA[128] = {
+    ['d'] = 1, ['q'] = -1, ['z'] = -LARGEURLIGNE, ['s'] = LARGEURLIGNE
+};
+
+/** @brief Une issue (portail) : entrer dans la case d'entrée
+ * fait arriver le serpent sur la case de sortie. */
+typedef struct {
+    int entreeX, entreeY;
+    int sortieX, sortieY;
+} Portail;
+
+/** Issues du plateau : le milieu de chaque bordure
+ * renvoie sur la case intérieure du côté opposé. */
+const Portail PORTAILS[] = {
+    {0, HAUTEURMAX / 2, LARGEURMAX - 2, HAUTEURMAX / 2},
+    {LARGEURMAX - 1, HAUTEURMAX / 2, 1, HAUTEURMAX / 2},
+    {LARGEURMAX / 2, 0, LARGEURMAX / 2, HAUTEURMAX - 2},
+    {LARGEURMAX / 2, HAUTEURMAX - 1, LARGEURMAX / 2, 1},
+};
+/** Nombre d'issues déclarées dans PORTAILS. */
+const int NBPORTAILS = sizeof(PORTAILS) / sizeof(PORTAILS[0]);
+/** Nombre maximal de portails (toute la bordure ouverte). */
+#define MAXPORTAILS (2 * (LARGEURMAX + HAUTEURMAX))
+/** Si vrai, toute la bordure est traversable
+ * (règle de test3.c : on réapparaît du côté opposé). */
+const bool BORDURESOUVERTES = false;
+
+/** Nombre de mots de 64 bits couvrant une ligne du plateau. */
+#define MOTSLIGNE ((LARGEURMAX + 63) / 64)
+
+/** @brief Ensemble de cases du plateau, un bit par case
+ * (bit j du mot j / 64 de la ligne y pour la case (j, y)). */
+typedef struct {
+    uint64_t ligne[HAUTEURMAX][MOTSLIGNE];
+} Bitboard;
+
+/** @brief État complet d'une partie : une copie par memcpy
+ * suffit pour la dupliquer (recherche, simulations). */
+typedef struct {
+    char plateau[HAUTEURMAX +1][LARGEURMAX +1]; /**< plateau de jeu */
+    int tailleSerpent;                    /**< nombre de cases du serpent */
+    char direction;                       /**< direction actuelle */
+    Case posPomme;                        /**< position de la pomme */
+    int pommesMangees;                    /**< pommes mangées depuis le début */
+    int temporisation;                    /**< pause entre deux déplacements */
+    uint64_t generation;                  /**< renouvelée dès que la pomme ou
+                                               les pavés changent : une copie
+                                               la garde tant qu'ils sont les mêmes */
+    uint64_t graine;                      /**< état du générateur aléatoire */
+    uint64_t empreinte;                   /**< hachage de Zobrist du corps,
+                                               de la pomme et des pavés ;
+                                               complet : empreintePartie() */
+    int tete;                             /**< indice de la tête dans corps */
+    Case corps[MAXTAILLESERPENT];         /**< anneau : la tête en corps[tete],
+                                               le corps à sa suite */
+} Partie;
+
+/** Indice, dans un anneau de MAXTAILLESERPENT cases dont la tête est
+ * en t, du segment i (i < MAXTAILLESERPENT). */
+#define RANGANNEAU(t, i) ((t) + (i) < MAXTAILLESERPENT ? (t) + (i) : (t) + (i) - MAXTAILLESERPENT)
+/** Case du segment i (0 pour la tête) du serpent d'une partie. */
+#define SEGMENT(p, i) ((p)->corps[RANGANNEAU((p)->tete, i)])
+
+/** @brief Partie jouée dans le terminal. */
+Partie partie;
+
+/** Signature d'une sauvegarde de partie. */
+const char MAGIESAUVEGARDE[4] = {'S', 'N', 'K', '1'};
+
+/** @brief En-tête d'une sauvegarde : une sauvegarde n'est relue
+ * que par un programme compilé avec le même plateau. */
+typedef struct {
+    char magie[4];                        /**< MAGIESAUVEGARDE */
+    uint16_t largeur, hauteur;            /**< LARGEURMAX et HAUTEURMAX */
+    uint32_t taillePartie;                /**< sizeof(Partie) */
+} EnteteSauvegarde;
+
+/** Taille fixe d'une sauvegarde (en-tête puis partie, dans
+ * la représentation mémoire de la machine). */
+#define TAILLESAUVEGARDE (sizeof(EnteteSauvegarde) + sizeof(Partie))
+
+/** Nombre de déplacements gardés pour revenir en arrière. */
+#define MAXREMBOBINAGE 128
+/** Déplacements annulés par la touche RETOUR. */
+const int PASREMBOBINAGE = 20;
+
+/** @brief Derniers états de la partie, dans un anneau. */
+typedef struct {
+    Partie etats[MAXREMBOBINAGE];
+    int prochain;                         /**< case où ranger le prochain état */
+    int nb;                               /**< états disponibles */
+} Rembobinage;
+
+/** @brief Historique de la partie jouée dans le terminal. */
+Rembobinage historique;
+
+/** @brief Nombre de pommes à manger pour gagner (modifiable par --pommes). */
+int nbrePommesFinJeu = NBREPOMMESFINJEU;
+
+/** @brief Case réellement atteinte en entrant dans chaque case :
+ * elle-même, sauf pour les entrées de portails. */
+Case redirection[NBCASES];
+
+/** @brief Liste des portails ouverts, pour les parcours sur bitboards. */
+Case entreesPortails[MAXPORTAILS], sortiesPortails[MAXPORTAILS];
+int nbPortails = 0;
+
+/** Graine fixe des clés de Zobrist : les empreintes restent
+ * comparables d'une exécution à l'autre. */
+const uint64_t GRAINEZOBRIST = 0x5EA101C0FFEEULL;
+
+/** @brief Clés de Zobrist : un nombre aléatoire par élément de l'état,
+ * l'empreinte d'une partie étant le ou exclusif de ses éléments. */
+typedef struct {
+    uint64_t corps[NBCASES];              /**< segment (tête comprise) sur la case */
+    uint64_t tete[NBCASES];               /**< tête sur la case */
+    uint64_t pomme[NBCASES];              /**< pomme sur la case */
+    uint64_t pave[NBCASES];               /**< case d'un pavé */
+    uint64_t direction[128];              /**< indexé par la touche, comme DELTA */
+} ClesZobrist;
+
+/** @brief Clés de Zobrist, communes à toutes les parties. */
+ClesZobrist zobrist;
+
+/** @brief Tampons de travail des parcours, alloués une fois pour toutes
+ * (un jeu par thread, les simulations pouvant tourner en parallèle). */
+_Thread_local Bitboard bbLibres, bbVus, bbFront, bbSuivant;
+
+/** Distance d'une case inaccessible depuis la pomme. */
+#define INACCESSIBLE UINT16_MAX
+/** @brief Nombre de déplacements pour atteindre la pomme depuis chaque case
+ * (le corps du serpent est compté comme libre). */
+uint16_t distancePomme[NBCASES];
+/** @brief Génération de la partie pour laquelle distancePomme a été
+ * calculée (0 : jamais). */
+uint64_t generationDistance = 0;
+/** @brief Dernière génération attribuée, toutes parties et threads confondus. */
+_Atomic uint64_t derniereGeneration = 0;
+
+/**
+ * @brief Génération neuve pour une partie dont la pomme ou les pavés
+ * changent (les simulations en attribuent depuis plusieurs threads).
+ */
+static inline uint64_t nouvelleGeneration(void) {
+    return atomic_fetch_add_explicit(&derniereGeneration, 1, memory_order_relaxed) + 1;
+}
+
+/** @brief Origine des changements de direction. */
+typedef enum {
+    PILOTE_CLAVIER,   /**< touches du joueur */
+    PILOTE_ASTAR,     /**< autopilote A* vers la pomme */
+    PILOTE_HAMILTON,  /**< cycle hamiltonien avec raccourcis */
+    PILOTE_MCTS       /**< recherche arborescente Monte-Carlo */
+} Pilote;
+
+/** @brief Tampons de l'autopilote, réutilisés à chaque décision
+ * (les tableaux indexés par case sont invalidés par numéro de tour
+ * plutôt que remis à zéro). */
+typedef struct {
+    uint32_t tour;                        /**< numéro du calcul en cours */
+    uint32_t vu[NBCASES];                 /**< tour où la case a été atteinte */
+    uint32_t ferme[NBCASES];              /**< tour où la case a été traitée */
+    uint32_t occupe[NBCASES];             /**< tour où la case porte le corps */
+    uint16_t libereApres[NBCASES];        /**< déplacements avant libération */
+    uint16_t g[NBCASES];                  /**< déplacements depuis la tête */
+    Case venant[NBCASES];                 /**< case précédente du chemin */
+    char dirVenant[NBCASES];              /**< touche menant à la case */
+    uint64_t tas[4 * NBCASES];            /**< file de priorité (f, case) */
+    Case corpsVirtuel[MAXTAILLESERPENT + 1]; /**< serpent après le chemin */
+    char chemin[NBCASES];                 /**< touches vers la pomme */
+    char essai[NBCASES];                  /**< chemin de vérification */
+    int longueur, suivant;                /**< chemin en cours de suivi */
+    Case pommeVisee;                      /**< pomme visée par le chemin */
+    long nbDecisions;                     /**< statistiques */
+    double dureeDecisions;                /**< en microsecondes */
+} Autopilote;
+
+/** @brief Autopilote de la partie. */
+Autopilote ia;
+
+/** Rang d'une case qui n'appartient pas au cycle. */
+#define HORSCYCLE ((Case)-1)
+/** Nombre de blocs 2x2 sur la largeur et la hauteur de l'intérieur. */
+#define BLOCSX ((LARGEURMAX - 2) / 2)
+#define BLOCSY ((HAUTEURMAX - 2) / 2)
+/** Le serpent prend des raccourcis tant qu'il occupe
+ * moins de cette fraction (en pourcentage) du cycle. */
+const int RACCOURCISJUSQUA = 50;
 
+/** @brief Cycle hamiltonien sur les cases libres :
+ * chaque case connaît son rang et la touche menant à la suivante. */
+typedef struct {
+    bool actif;                           /**< les pommes restent sur le cycle */
+    Case rang[NBCASES];                   /**< position dans le cycle */
+    char suivante[NBCASES];               /**< touche vers la case suivante */
+    int longueur;                         /**< nombre de cases du cycle */
+    int prudence;                         /**< déplacements avant que le corps
+                                               soit de nouveau rangé sur le cycle */
+    int composante[BLOCSY * BLOCSX];      /**< composante de chaque bloc */
+    int file[BLOCSY * BLOCSX];            /**< file du parcours des blocs */
+    unsigned char aretes[BLOCSY * BLOCSX];/**< arbre couvrant : 1 vers le bloc
+                                               de droite, 2 vers celui du dessous */
+    int parent[BLOCSY * BLOCSX];          /**< arbre enraciné sur la tête */
+    bool reserve[BLOCSY * BLOCSX];        /**< blocs interdits aux pavés */
+    long nbReconstructions;               /**< statistiques */
+    double dureeReconstructions;          /**< en microsecondes */
+    long nbDecisions;
+    double dureeDecisions;
+} CycleHamiltonien;
 
-/** @brief Variables globales modifiables en cours de jeu. */
-int tailleSerpent = TAILLESERPENT;
-int temporisation = TEMPORISATION;
+/** @brief Cycle suivi par le pilote hamiltonien. */
+CycleHamiltonien hc;
 
+/** Nombre maximal de threads de recherche Monte-Carlo. */
+#define MAXTHREADSMCTS 64
+/** Nombre de noeuds de l'arbre de chaque thread. */
+#define MAXNOEUDSMCTS 50000
+/** Nombre maximal de déplacements d'une simulation. */
+#define PROFONDEURSIMULATION 60
+/** Constante d'exploration de la formule UCB1. */
+const double EXPLORATIONMCTS = 0.5;
+/** Dépréciation d'une pomme à chaque déplacement de retard. */
+const double DEPRECIATIONMCTS = 0.95;
 
-/** @brief Position de la pomme. */
-int posX_pomme = -1, posY_pomme = -1;
+/** @brief Noeud de l'arbre de recherche : une suite de touches
+ * depuis la position actuelle. */
+typedef struct {
+    int enfants[4];                       /**< par touche, -1 si absent */
+    int visites;                          /**< simulations passées par ici */
+    double gains;                         /**< somme des récompenses */
+} Noeud;
+
+/** @brief Travail d'un thread de recherche : son propre arbre
+ * et sa propre copie de la partie. */
+typedef struct {
+    pthread_t thread;
+    Noeud *noeuds;                        /**< alloué une fois pour toutes */
+    int nbNoeuds;
+    uint64_t graine;                      /**< générateur du thread */
+    long simulations;                     /**< simulations de la décision */
+    int profondeur;                       /**< déplacements de la simulation */
+    int premierePomme;                    /**< déplacement de la première
+                                               pomme mangée, -1 si aucune */
+    Partie simulation;                    /**< partie rejouée à chaque simulation */
+} RechercheMCTS;
+
+/** @brief Joueur Monte-Carlo : un groupe de threads qui cherchent
+ * chacun depuis la même position jusqu'à l'échéance. */
+typedef struct {
+    int nbThreads;
+    RechercheMCTS *recherches;
+    pthread_mutex_t verrou;
+    pthread_cond_t debut, fin;
+    unsigned long generation;             /**< numéro de la décision */
+    int enCours;                          /**< threads pas encore terminés */
+    bool arret;
+    Partie racine;                        /**< position à jouer */
+    int distanceRacine;                   /**< de la tête à la pomme */
+    struct timespec echeance;
+    int budget;                           /**< microsecondes par décision,
+                                               0 pour toute la temporisation */
+    long dureeDecision;                   /**< microsecondes de la dernière décision */
+    long nbDecisions, totalSimulations;   /**< statistiques */
+    double dureeTotale;                   /**< en secondes */
+} JoueurMCTS;
+
+/** @brief Joueur Monte-Carlo de la partie. */
+JoueurMCTS mcts;
+
+/** @brief Plans d'une observation : un octet à 1 par case concernée. */
+typedef enum {
+    PLAN_OBSTACLE,    /**< bordure ou pavé */
+    PLAN_CORPS,       /**< serpent, tête comprise */
+    PLAN_TETE,        /**< tête seule */
+    PLAN_POMME,       /**< pomme */
+    PLAN_ISSUE,       /**< entrée de portail */
+    NBPLANS
+} Plan;
+
+/** Nombre de cases d'un plan (lignes de LARGEURMAX cases). */
+#define TAILLEPLAN (HAUTEURMAX * LARGEURMAX)
+/** Taille en octets de l'observation d'une partie. */
+#define TAILLEOBSERVATION (NBPLANS * TAILLEPLAN)
+/** Demi-côté de la fenêtre d'observation centrée sur la tête. */
+#define RAYONFENETRE 7
+/** Côté de la fenêtre centrée sur la tête. */
+#define COTEFENETRE (2 * RAYONFENETRE + 1)
+/** Nombre de cases d'un plan de la fenêtre. */
+#define TAILLEPLANFENETRE (COTEFENETRE * COTEFENETRE)
+_Static_assert(COTEFENETRE <= 16, "une ligne de fenêtre doit tenir dans 16 cases");
+
+/** @brief Plan des entrées de portails, tenu à jour par ajouterPortail()
+ * (complété de 16 octets lus par l'encodeur de fenêtre). */
+uint8_t planIssues[TAILLEPLAN + 16];
+
+/** @brief Environnement d'apprentissage : nb parties jouées en même
+ * temps, dont les observations sont écrites dans le tampon de
+ * l'appelant (nb * TAILLEOBSERVATION octets, contigus). */
+typedef struct {
+    int nb;                               /**< nombre de parties */
+    Partie *parties;                      /**< allouées une fois pour toutes */
+    int *pasSansPomme;                    /**< pour couper les parties qui tournent en rond */
+    uint8_t *observations;                /**< tampon de l'appelant */
+    uint64_t graine;                      /**< graines des nouvelles parties */
+} Environnement;
+
+/** Premier octet d'une image clé du flux de diffusion. */
+const uint8_t IMAGECLE = 'K';
+/** Bits 5 à 7 du premier octet d'un delta (aucune image clé ne les a). */
+#define DELTAFLUX 0x80
+/** Bits 0 et 1 d'un delta : direction prise par la tête. */
+#define DELTADIRECTION 0x03
+/** Bit 2 d'un delta : la queue a avancé (pas de pomme mangée). */
+#define DELTAQUEUE 0x04
+/** Bit 3 d'un delta : nouvelle pomme, suivie de sa case. */
+#define DELTAPOMME 0x08
+/** Bit 4 d'un delta : nouveaux pavés, suivis de leur codage par plages. */
+#define DELTAPAVES 0x10
+/** Directions du flux, dans l'ordre de leur code sur 2 bits. */
+const char DIRECTIONSFLUX[4] = {DROITE, GAUCHE, HAUT, BAS};
+/** Ticks entre deux images clés par défaut. */
+const int INTERVALLEIMAGESCLES = 100;
+/** Taille maximale d'un message du flux (image clé du plus grand serpent). */
+#define TAILLEMAXFLUX (16 * NBCASES)
+/** Pause entre deux ticks relus par --relire, en microsecondes. */
+const int DELAIRELECTURE = 60000;
+
+/** @brief Encodeur du flux de diffusion : une image clé, puis un delta
+ * par tick (tête ajoutée, queue retirée, pomme et pavés changés),
+ * entiers codés en varint. Seul ce qui a changé depuis le tick
+ * précédent est retenu ici. */
+typedef struct {
+    int intervalle;                       /**< ticks entre deux images clés */
+    uint32_t tick;                        /**< ticks encodés */
+    bool aJour;                           /**< faux : la prochaine sortie sera une image clé */
+    Case tete, pomme;                     /**< au tick précédent */
+    int taille, pommes;
+    uint8_t message[TAILLEMAXFLUX];       /**< dernier message encodé */
+} Flux;
+
+/** Images gardées dans l'anneau des spectateurs. */
+#define NBIMAGESTRIBUNE 64
+/** Signature d'une tribune en mémoire partagée. */
+const char MAGIETRIBUNE[4] = {'S', 'N', 'K', 'T'};
+/** Pause entre deux coups d'oeil d'un spectateur, en microsecondes. */
+const int DELAISPECTATEUR = 20000;
+_Static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "les compteurs partagés doivent être sans verrou");
+
+/** @brief Issue de la partie, publiée avec chaque image. */
+typedef enum {
+    PARTIE_EN_COURS,
+    PARTIE_PERDUE,
+    PARTIE_GAGNEE,
+    PARTIE_ABANDONNEE
+} IssuePartie;
+
+/** @brief Ce qu'un spectateur voit d'un tick. */
+typedef struct {
+    uint32_t tick;
+    int32_t tailleSerpent, pommesMangees;
+    int32_t teteX, teteY;                 /**< position de la tête */
+    char direction;
+    uint8_t issue;                        /**< IssuePartie */
+    uint64_t empreinte;                   /**< empreintePartie() */
+    char plateau[HAUTEURMAX + 1][LARGEURMAX + 1];
+} ImageSpectateur;
+
+/** @brief Case de l'anneau des spectateurs, protégée par un verrou
+ * de séquence : impair pendant l'écriture de l'image n (2n + 1),
+ * 2n + 2 une fois l'image écrite. */
+typedef struct {
+    _Alignas(64) _Atomic uint64_t sequence;
+    ImageSpectateur image;
+} CaseTribune;
+
+/** @brief Tribune : anneau d'images en mémoire partagée, écrit par la
+ * partie seule et lu sans verrou par autant de spectateurs que l'on
+ * veut. La partie n'attend jamais un spectateur : un spectateur trop
+ * lent voit ses images écrasées et le sait par leur séquence. */
+typedef struct {
+    char magie[4];                        /**< MAGIETRIBUNE, écrite en dernier */
+    uint16_t largeur, hauteur;            /**< LARGEURMAX et HAUTEURMAX */
+    uint32_t nbImages, tailleImage;       /**< NBIMAGESTRIBUNE, sizeof(ImageSpectateur) */
+    _Atomic uint64_t publiees;            /**< images publiées depuis le début */
+    _Atomic bool remplacee;               /**< une autre partie a pris le nom */
+    CaseTribune cases[NBIMAGESTRIBUNE];
+} Tribune;
+
+/** Bit du tampon du milieu d'un Rendu : il porte une image neuve,
+ * que le fil de rendu n'a pas encore prise. */
+#define IMAGENEUVE 4
+
+/** Octets envoyés au terminal pour une image, au pire : par case un
+ * déplacement du curseur (12 octets au plus), une couleur (24) et un
+ * glyphe (4), plus l'effacement initial et les séquences du Terminal. */
+#define TAILLESORTIERENDU (HAUTEURMAX * LARGEURMAX * 40 + 128)
+
+/** Attente maximale des réponses du terminal à la détection, en ms. */
+const int DELAIDETECTION = 200;
+
+/** Attente maximale, à l'arrêt du rendu, d'un terminal qui ne prend
+ * plus rien, en ms : l'envoi en cours est alors abandonné. */
+const int DELAIARRETRENDU = 500;
+
+/** @brief Couleurs du dessin ; COULEUR_INDIFFERENTE pour une case qui
+ * se dessine dans n'importe laquelle (une case vide). */
+typedef enum {
+    COULEUR_INDIFFERENTE,
+    COULEUR_NORMALE,
+    COULEUR_SERPENT,
+    COULEUR_POMME,
+    COULEUR_PAVE,
+    COULEUR_BORDURE,
+    NBCOULEURS
+} Couleur;
+
+/** @brief Apparence d'une case à l'écran. APPARENCE_CARACTERE, pour tout
+ * caractère inattendu, dessine le caractère du plateau tel quel. */
+typedef enum {
+    APPARENCE_CARACTERE,
+    APPARENCE_VIDE,
+    APPARENCE_TETE,
+    APPARENCE_CORPS,
+    APPARENCE_POMME,
+    APPARENCE_PAVE,
+    APPARENCE_BORD_HORIZONTAL,
+    APPARENCE_BORD_VERTICAL,
+    APPARENCE_COIN_HAUT_GAUCHE,
+    APPARENCE_COIN_HAUT_DROIT,
+    APPARENCE_COIN_BAS_GAUCHE,
+    APPARENCE_COIN_BAS_DROIT,
+    NBAPPARENCES
+} Apparence;
+
+/** @brief Ce que sait faire le terminal, détecté une fois au démarrage,
+ * et les séquences correspondantes déjà assemblées : les placer dans une
+ * image ne coûte qu'une recopie. Les séquences d'une capacité absente
+ * sont vides. */
+typedef struct {
+    bool synchronise;                     /**< mode 2026 : images sans déchirure */
+    bool ecranAlterne;                    /**< mode 1049 */
+    bool curseurCache;                    /**< mode 25 */
+    bool vraiesCouleurs;                  /**< couleurs sur 24 bits */
+    bool enCouleurs;                      /**< couleurs ANSI, sauf NO_COLOR */
+    bool unicode;                         /**< locale UTF-8 : glyphes et traits */
+    int lignes, colonnes;                 /**< taille du terminal, 0 si inconnue */
+    char debutImage[16], finImage[16];    /**< autour de chaque image */
+    size_t tailleDebutImage, tailleFinImage;
+    char entree[32], sortie[32];          /**< autour de la partie */
+    size_t tailleEntree, tailleSortie;
+    /** Dessin de chaque case : tout à zéro, chaque caractère du plateau
+     * est écrit tel quel, sans couleur. */
+    char sequencesCouleurs[NBCOULEURS][24];
+    uint8_t taillesCouleurs[NBCOULEURS];
+    char glyphes[NBAPPARENCES][4];        /**< UTF-8, vide : le caractère du plateau */
+    uint8_t taillesGlyphes[NBAPPARENCES];
+    uint8_t couleursGlyphes[NBAPPARENCES];
+    uint8_t apparences[256];              /**< Apparence de chaque caractère */
+    uint8_t formesBordure[HAUTEURMAX][LARGEURMAX]; /**< Apparence d'un CARBORDURE à cette place */
+} Terminal;
+
+/** @brief Terminal de la partie. */
+Terminal terminal;
+
+/** Écart maximal entre deux cases modifiées d'une même ligne en deçà
+ * duquel on réécrit les cases intactes plutôt que de déplacer le curseur. */
+#define ECARTRECOPIE 4
+
+/** Coût d'une commande de défilement, en cases redessinées : la caméra
+ * ne fait glisser l'écran que s'il y a plus à gagner. */
+#define COUTDEFILEMENT 8
+
+/** Lignes et colonnes de caractères braille au plus : un caractère
+ * porte 2 x 4 points. */
+#define LIGNESBRAILLE ((HAUTEURMAX + 3) / 4)
+#define COLONNESBRAILLE ((LARGEURMAX + 1) / 2)
+
+/** Taille du tampon circulaire d'un enregistrement, en octets : la plus
+ * grosse image possible, plus une marge d'images ordinaires. */
+#define TAILLEENREGISTREMENT (TAILLESORTIERENDU + (1 << 20))
+
+/** @brief En-tête de chaque image dans le tampon d'un enregistrement,
+ * suivi de ses octets. */
+typedef struct {
+    double temps;                         /**< secondes depuis le début */
+    size_t taille;                        /**< octets de l'image */
+} EnteteEnregistrement;
+
+/** @brief Enregistrement asciicast v2 de ce que le rendu envoie au
+ * terminal. Le fil de rendu dépose chaque image, datée, dans un tampon
+ * circulaire borné ; un fil d'écriture la code en JSON et l'écrit sur
+ * le disque. Un disque lent n'arrête que le fil de rendu, quand le
+ * tampon est plein : la partie continue et des images sont sautées,
+ * comme avec un terminal lent. */
+typedef struct {
+    FILE *fichier;
+    char *anneau;                         /**< TAILLEENREGISTREMENT octets */
+    size_t debut, occupes;                /**< partie occupée de l'anneau */
+    pthread_mutex_t verrou;               /**< protège l'anneau et fin */
+    pthread_cond_t place, images;
+    bool fin;
+    pthread_t fil;
+    struct timespec depart;
+    long attentes;                        /**< fois où le rendu a attendu le disque */
+    char *image;                          /**< image en cours d'écriture */
+} Enregistrement;
+
+/** @brief Rendu dans un fil à part, alimenté par un triple tampon :
+ * la simulation remplit son tampon puis l'échange avec celui du milieu,
+ * le fil de rendu échange le sien avec le milieu quand une image neuve
+ * y attend. Aucun des deux n'attend l'autre ; une image que le rendu
+ * n'a pas eu le temps de prendre est remplacée par la suivante. */
+typedef struct {
+    ImageSpectateur images[3];
+    _Atomic uint8_t milieu;               /**< tampon du milieu, plus IMAGENEUVE */
+    uint8_t ecriture;                     /**< tampon de la simulation */
+    uint8_t lecture;                      /**< tampon du fil de rendu */
+    sem_t signal;                         /**< réveille le fil de rendu */
+    _Atomic bool arret;
+    pthread_t fil;
+    long publiees, sautees;               /**< tenus par la simulation */
+    /** le reste appartient au fil de rendu */
+    int sortie;                           /**< terminal, non bloquant si possible */
+    char ecran[HAUTEURMAX][LARGEURMAX];   /**< ce que montre le terminal */
+    bool ecranConnu;                      /**< faux avant le premier effacement */
+    char tampon[TAILLESORTIERENDU];       /**< image en cours d'envoi */
+    size_t aEnvoyer, envoyes;
+    bool retenue;                         /**< le terminal a déjà refusé cette image */
+    bool coupee;                          /**< une image a été abandonnée en cours d'envoi */
+    uint8_t couleur;                      /**< Couleur en cours dans le terminal */
+    long retenues;                        /**< images envoyées en plusieurs fois */
+    /** vue réduite en braille, quand le plateau ne tient pas dans le terminal */
+    int echelle;                          /**< cases par point sur chaque axe, 0 : sans braille */
+    int lignesBraille, colonnesBraille;   /**< taille de la vue réduite */
+    Bitboard pointsDecor, pointsSerpent, pointsPomme;
+    uint8_t pointsEcran[LIGNESBRAILLE][COLONNESBRAILLE + 8]; /**< points montrés */
+    uint8_t couleursEcran[LIGNESBRAILLE][COLONNESBRAILLE];   /**< leur Couleur */
+    /** vue (case par case) ; avec la caméra, une fenêtre qui suit la tête */
+    bool camera;
+    int vueLignes, vueColonnes;           /**< taille de la vue, en cases */
+    int origineY, origineX;               /**< case du plateau en haut à gauche */
+    long defilements;                     /**< déplacements de caméra par défilement */
+    Enregistrement *enregistrement;       /**< copie des images envoyées, ou NULL */
+} Rendu;
 
 void gotoXY(int x, int y);
 void disableEcho();
 void enableEcho();
 int kbhit();
-void effacerPaves();
+uint32_t aleatoire(Partie *p);
+void initPortails();
+void initZobrist();
+uint64_t empreintePartie(const Partie *p);
+uint64_t recalculerEmpreinte(Partie *p);
+void initPartie(Partie *p, uint64_t graine);
+bool mangerPomme(Partie *p);
+void effacerPaves(Partie *p);
 void afficher(int x, int y, char c);
 void effacer(int x, int y);
-void dessinerPlateau(int lesX[], int lesY[]);
-void initPlateau();
-void placerPaves(int lesX[], int lesY[], char direction);
-void ajouterPomme();
-void progresser(int lesX[], int lesY[], char direction, bool *collision, bool *pommeMangee);
+void dessinerPlateau(Partie *p);
+void initPlateau(Partie *p);
+void ajouterPortail(int entreeX, int entreeY, int sortieX, int sortieY);
+void placerPaves(Partie *p);
+bool ajouterPomme(Partie *p);
+void progresser(Partie *p, bool *collision, bool *pommeMangee);
+void casesLibres(Partie *p, Bitboard *libres, bool corpsLibre);
+int coucheSuivante(const Bitboard *front, const Bitboard *vus,
+                   const Bitboard *libres, bool inverse, Bitboard *suivant);
+bool plateauConnexe(Partie *p, Case depart);
+void calculerDistancePomme(Partie *p);
+int distanceALaPomme(Partie *p, Case c);
+void initAutopilote();
+int chercherChemin(Partie *p, const Case corpsS[], int teteS, int taille, Case cible, bool versPomme, char dirs[]);
+bool cheminSur(Partie *p, const Case corpsS[], int teteS, int taille, int longueur);
+char decisionAutopilote(Partie *p);
+void construireCycle(Partie *p);
+void reserverCycle(Partie *p);
+bool caseReservee(Case c);
+bool placerPommeSurCycle(Partie *p);
+char decisionHamilton(Partie *p);
+void copierPartie(Partie *dst, const Partie *src);
+void sauvegarderPartie(const Partie *p, unsigned char sauvegarde[TAILLESAUVEGARDE]);
+bool restaurerPartie(Partie *p, const unsigned char sauvegarde[TAILLESAUVEGARDE]);
+void memoriserEtat(Rembobinage *r, const Partie *p);
+int rembobiner(Rembobinage *r, Partie *p, int n);
+void initMCTS(int nbThreads);
+void arreterMCTS();
+char decisionMCTS(Partie *p);
+void encoderPlateau(Partie *p, uint8_t observation[TAILLEOBSERVATION]);
+void encoderFenetre(Partie *p, uint8_t observation[NBPLANS * TAILLEPLANFENETRE]);
+bool initEnvironnement(Environnement *e, int nb, uint64_t graine, uint8_t *observations);
+void avancerEnvironnement(Environnement *e, const int actions[], float recompenses[], bool finies[]);
+void libererEnvironnement(Environnement *e);
+void mesurerEnvironnement(int nb);
+void initFlux(Flux *f, int intervalle);
+int encoderImageCle(Flux *f, const Partie *p);
+int encoderTick(Flux *f, const Partie *p);
+int decoderFlux(Partie *p, const uint8_t *message, int taille);
+void relireFlux(const char *fichier);
+Tribune *ouvrirTribune(const char *nom);
+void publierImage(Tribune *t, const Partie *p, uint32_t tick, IssuePartie issue);
+void fermerTribune(Tribune *t, const char *nom);
+void remplirImage(ImageSpectateur *image, const Partie *p, uint32_t tick, IssuePartie issue);
+void dessinerCases(const char plateau[HAUTEURMAX + 1][LARGEURMAX + 1]);
+void detecterTerminal(void);
+char *coderCase(char *o, uint8_t *couleur, char c, int i, int j);
+void lancerRendu(Rendu *r, bool braille, bool camera, Enregistrement *e);
+void publierRendu(Rendu *r, const Partie *p, uint32_t tick);
+void arreterRendu(Rendu *r);
+bool ouvrirEnregistrement(Enregistrement *e, const char *chemin);
+void commencerEnregistrement(Enregistrement *e, int largeur, int hauteur);
+void enregistrer(Enregistrement *e, const char *octets, size_t taille);
+void fermerEnregistrement(Enregistrement *e);
+const Tribune *rejoindreTribune(const char *nom);
+int lireImage(const Tribune *t, uint64_t numero, ImageSpectateur *image);
+void regarderPartie(const char *nom);
 
 /*****************************************************
 *               PROGRAMME PRINCIPAL                  *
 *****************************************************/
 
+/** SERPENT_SANS_MAIN permet d'inclure ce fichier pour en réutiliser
+ * les règles (serveur.c) sans son programme principal. */
+#ifndef SERPENT_SANS_MAIN
+
 
 /**
  * @brief Programme principal gérant le déroulement du jeu.
+ * @param argc Nombre d'arguments.
+ * @param argv Arguments : "--auto" confie le serpent à l'autopilote,
+ * "--hamilton" au pilote suivant un cycle hamiltonien,
+ * "--mcts" à la recherche Monte-Carlo ("--budget µs" par coup,
+ * "--threads N"),
+ * "--pommes N" change le nombre de pommes à manger,
+ * "--rapide" supprime l'affichage et la temporisation,
+ * "--charger fichier" reprend une partie sauvegardée,
+ * "--sauvegarder fichier" sauvegarde la dernière position
+ * (avant le déplacement fatal en cas de collision),
+ * "--env N" mesure le débit de l'environnement d'apprentissage
+ * sur N parties jouées au hasard,
+ * "--diffuser fichier" écrit la partie en flux compressé (image clé
+ * toutes les "--images-cles N" ticks, deltas entre les deux),
+ * "--relire fichier" rejoue un tel flux,
+ * "--publier nom" publie chaque tick dans une tribune en mémoire
+ * partagée, que "--regarder nom" affiche depuis un autre terminal.
+ * Hors "--rapide", le plateau est dessiné par un fil à part ;
+ * "--braille" le réduit en caractères braille, ce qui est fait d'office
+ * quand il ne tient pas dans le terminal, "--camera" n'en montre qu'une
+ * fenêtre à la taille du terminal, qui suit la tête, et
+ * "--enregistrer fichier" copie ce qu'il envoie au terminal dans un
+ * enregistrement asciicast v2.
  * @return Code de sortie du programme.
  */
-int main() {
+int main(int argc, char *argv[]) {
 
     /** Déclaration des variables */
-    int lesX[MAXTAILLESERPENT] = {40, 39, 38, 37, 36, 35, 34, 33, 32, 31};
-    int lesY[MAXTAILLESERPENT] = {20, 20, 20, 20, 20, 20, 20, 20, 20, 20};
-    char direction = DROITE;
+    Partie *p = &partie;
     bool collision = false;
     bool pommeMangee = false;
     bool forfait = false;
-    int pommesMangees = 0;
+    bool plateauRempli = false;
+    Pilote pilote = PILOTE_CLAVIER;
+    bool rapide = false;
+    bool braille = false;
+    bool camera = false;
+    int nbThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    const char *fichierCharge = NULL, *fichierSauvegarde = NULL;
+    static unsigned char sauvegarde[TAILLESAUVEGARDE];
+    FILE *diffusion = NULL;
+    int intervalleImagesCles = INTERVALLEIMAGESCLES;
+    static Flux flux;
+    const char *nomTribune = NULL;
+    Tribune *tribune = NULL;
+    uint32_t tick = 0;
+    static Rendu rendu;
+    const char *fichierEnregistrement = NULL;
+    static Enregistrement enregistrement;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--auto") == 0) pilote = PILOTE_ASTAR;
+        if (strcmp(argv[i], "--hamilton") == 0) pilote = PILOTE_HAMILTON;
+        if (strcmp(argv[i], "--mcts") == 0) pilote = PILOTE_MCTS;
+        if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc) {
+            mcts.budget = atoi(argv[++i]);
+        }
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            nbThreads = atoi(argv[++i]);
+        }
+        if (strcmp(argv[i], "--rapide") == 0) rapide = true;
+        if (strcmp(argv[i], "--braille") == 0) braille = true;
+        if (strcmp(argv[i], "--camera") == 0) camera = true;
+        if (strcmp(argv[i], "--pommes") == 0 && i + 1 < argc) {
+            nbrePommesFinJeu = atoi(argv[++i]);
+        }
+        if (strcmp(argv[i], "--charger") == 0 && i + 1 < argc) {
+            fichierCharge = argv[++i];
+        }
+        if (strcmp(argv[i], "--sauvegarder") == 0 && i + 1 < argc) {
+            fichierSauvegarde = argv[++i];
+        }
+        if (strcmp(argv[i], "--diffuser") == 0 && i + 1 < argc) {
+            diffusion = fopen(argv[++i], "wb");
+            if (diffusion == NULL) {
+                fprintf(stderr, "Impossible d'ouvrir le flux : %s\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        }
+        if (strcmp(argv[i], "--images-cles") == 0 && i + 1 < argc) {
+            intervalleImagesCles = atoi(argv[++i]);
+        }
+        if (strcmp(argv[i], "--publier") == 0 && i + 1 < argc) {
+            nomTribune = argv[++i];
+        }
+        if (strcmp(argv[i], "--enregistrer") == 0 && i + 1 < argc) {
+            fichierEnregistrement = argv[++i];
+        }
+    }
+
+    if (!rapide) detecterTerminal();
+
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--env") == 0) {
+            initPortails();
+            initZobrist();
+            mesurerEnvironnement(atoi(argv[i + 1]));
+            return EXIT_SUCCESS;
+        }
+        if (strcmp(argv[i], "--relire") == 0) {
+            initZobrist();
+            relireFlux(argv[i + 1]);
+            return EXIT_SUCCESS;
+        }
+        if (strcmp(argv[i], "--regarder") == 0) {
+            regarderPartie(argv[i + 1]);
+            return EXIT_SUCCESS;
+        }
+    }
 
-    /** Appel des fonctions pour l'affichage du plateeau, 
-     * des pavés 
+    /** Appel des fonctions pour l'initialisation du plateau, 
+     * du serpent, des pavés 
      * et de la première pomme */
-    initPlateau();
-    placerPaves(lesX, lesY,direction);
-    ajouterPomme();
-    dessinerPlateau(lesX, lesY);
+    initPortails();
+    initZobrist();
+    if (fichierCharge != NULL) {
+        FILE *f = fopen(fichierCharge, "rb");
+        if (f == NULL || fread(sauvegarde, TAILLESAUVEGARDE, 1, f) != 1 ||
+            !restaurerPartie(p, sauvegarde)) {
+            fprintf(stderr, "Sauvegarde illisible : %s\n", fichierCharge);
+            return EXIT_FAILURE;
+        }
+        fclose(f);
+    } else {
+        initPartie(p, (uint64_t)time(NULL) ^ ((uint64_t)getpid() << 32));
+    }
+    if (pilote == PILOTE_HAMILTON) {
+        construireCycle(p);
+        placerPommeSurCycle(p);
+    }
+    if (pilote != PILOTE_CLAVIER) initAutopilote();
+    if (pilote == PILOTE_MCTS) initMCTS(nbThreads);
+    /** sans rendu, rien à enregistrer */
+    if (rapide) fichierEnregistrement = NULL;
+    if (fichierEnregistrement != NULL &&
+        !ouvrirEnregistrement(&enregistrement, fichierEnregistrement)) {
+        fprintf(stderr, "Impossible d'ouvrir l'enregistrement : %s\n", fichierEnregistrement);
+        return EXIT_FAILURE;
+    }
+    if (!rapide) {
+        lancerRendu(&rendu, braille, camera,
+                    fichierEnregistrement != NULL ? &enregistrement : NULL);
+        publierRendu(&rendu, p, tick);
+    }
+    if (diffusion != NULL) {
+        initFlux(&flux, intervalleImagesCles);
+        fwrite(flux.message, 1, encoderImageCle(&flux, p), diffusion);
+        fflush(diffusion);
+    }
+    if (nomTribune != NULL) {
+        tribune = ouvrirTribune(nomTribune);
+        if (tribune == NULL) {
+            fprintf(stderr, "Impossible d'ouvrir la tribune : %s\n", nomTribune);
+            return EXIT_FAILURE;
+        }
+        publierImage(tribune, p, tick, PARTIE_EN_COURS);
+    }
 
     disableEcho();
 
     /** Boucle principale */
-    while (!collision && pommesMangees < NBREPOMMESFINJEU) {
+    while (!collision && p->pommesMangees < nbrePommesFinJeu) {
+        char touche = 0;
         if (kbhit()) {
-            char touche = getchar();
-            if ((touche == DROITE && direction != GAUCHE) ||
-                (touche == GAUCHE && direction != DROITE) ||
-                (touche == HAUT && direction != BAS) ||
-                (touche == BAS && direction != HAUT)) {
-                direction = touche;
-            }
-            if (touche == ARRET){
-            forfait = true;
-            break;
+            touche = getchar();
+        }
+        if (touche == RETOUR && rembobiner(&historique, p, PASREMBOBINAGE) > 0) {
+            /** les pilotes repartent de la position retrouvée */
+            if (pilote == PILOTE_HAMILTON) {
+                construireCycle(p);
+                placerPommeSurCycle(p);
             }
+            ia.pommeVisee = NBCASES - 1;
+            /** les spectateurs repartent d'une image clé */
+            flux.aJour = false;
+            if (tribune != NULL) publierImage(tribune, p, tick, PARTIE_EN_COURS);
+            if (!rapide) publierRendu(&rendu, p, tick);
+            continue;
+        }
+        memoriserEtat(&historique, p);
+        /** l'autopilote remplace les touches de direction,
+         * le joueur peut toujours abandonner */
+        if (pilote == PILOTE_ASTAR && touche != ARRET) {
+            touche = decisionAutopilote(p);
+        }
+        if (pilote == PILOTE_HAMILTON && touche != ARRET) {
+            touche = decisionHamilton(p);
+        }
+        if (pilote == PILOTE_MCTS && touche != ARRET) {
+            touche = decisionMCTS(p);
+        }
+        if (directionValide(touche, p->direction)) {
+            p->direction = touche;
+        }
+        if (touche == ARRET){
+        forfait = true;
+        break;
         }
 
-        progresser(lesX, lesY, direction, &collision, &pommeMangee);
+        progresser(p, &collision, &pommeMangee);
 
         if (pommeMangee) {
-            pommesMangees++;
-            temporisation = temporisation - AUGMENTATIONVITESSE;
-            tailleSerpent++;
-            ajouterPomme();
-
-            effacerPaves();
-            placerPaves(lesX, lesY, direction);
+            /** les pavés ne doivent pas couper le cycle sous le serpent */
+            if (pilote == PILOTE_HAMILTON) reserverCycle(p);
+            if (!mangerPomme(p)) {
+                plateauRempli = true;
+                break;
+            }
+            if (pilote == PILOTE_HAMILTON) {
+                /** les pavés ont changé : nouveau cycle,
+                 * et la pomme doit se trouver dessus */
+                construireCycle(p);
+                if (!placerPommeSurCycle(p)) {
+                    plateauRempli = true;
+                    break;
+                }
+            }
+        }
+        tick++;
+        if (diffusion != NULL) {
+            fwrite(flux.message, 1, encoderTick(&flux, p), diffusion);
+            fflush(diffusion);
+        }
+        if (tribune != NULL) publierImage(tribune, p, tick, PARTIE_EN_COURS);
+        if (!rapide) {
+            /** le dessin se fait dans le fil de rendu : un terminal
+             * lent ne ralentit pas la partie, il saute des images */
+            publierRendu(&rendu, p, tick);
+            /** le joueur Monte-Carlo a déjà passé une partie du tick
+             * à réfléchir : la partie garde la même vitesse */
+            long attente = p->temporisation;
+            if (pilote == PILOTE_MCTS) attente -= mcts.dureeDecision;
+            if (attente > 0) usleep(attente);
         }
-        dessinerPlateau(lesX, lesY);
-        usleep(temporisation);
     }
+    if (!rapide) arreterRendu(&rendu);
+    if (fichierEnregistrement != NULL) fermerEnregistrement(&enregistrement);
     enableEcho();
+    if (diffusion != NULL) fclose(diffusion);
+    if (tribune != NULL) {
+        IssuePartie issue = collision ? PARTIE_PERDUE : forfait ? PARTIE_ABANDONNEE : PARTIE_GAGNEE;
+        publierImage(tribune, p, tick, issue);
+        fermerTribune(tribune, nomTribune);
+    }
+    if (pilote == PILOTE_MCTS) arreterMCTS();
+    if (fichierSauvegarde != NULL) {
+        /** après une collision, la position d'avant le déplacement fatal */
+        if (collision) rembobiner(&historique, p, 1);
+        sauvegarderPartie(p, sauvegarde);
+        FILE *f = fopen(fichierSauvegarde, "wb");
+        if (f == NULL || fwrite(sauvegarde, TAILLESAUVEGARDE, 1, f) != 1) {
+            fprintf(stderr, "Impossible d'écrire la sauvegarde : %s\n", fichierSauvegarde);
+        }
+        if (f != NULL) fclose(f);
+    }
 
     /** Phrase de fin de jeu en fonction de l'issue de la partie */
     if (collision) {
         system("clear");
         printf("Collision détectée. Vous avez perdu.\n");
     }
-    else if (pommesMangees == NBREPOMMESFINJEU) {
+    else if (p->pommesMangees == nbrePommesFinJeu || plateauRempli) {
         system("clear");
         printf("Vous avez gagné. Félicitations !\n");
     } 
@@ -184,22 +1020,169 @@ int main() {
         system("clear");
         printf("Vous avez déclaré forfait. Dommage !\n");
     }
+    /** la première image, remplacée avant le démarrage du fil de rendu,
+     * ne compte pas : seul un terminal qui a refusé des octets est lent */
+    if (rendu.retenues > 0) {
+        printf("Rendu : %ld images publiées, %ld sautées, %ld envoyées en plusieurs fois "
+               "(terminal trop lent).\n",
+               rendu.publiees, rendu.sautees, rendu.retenues);
+    }
+    if (enregistrement.attentes > 0) {
+        printf("Enregistrement : le rendu a attendu le disque %ld fois.\n",
+               enregistrement.attentes);
+    }
+    if (pilote == PILOTE_MCTS && mcts.dureeTotale > 0) {
+        printf("Monte-Carlo : %d pommes, %d threads, %ld simulations par coup, "
+               "%.0f simulations/s.\n",
+               p->pommesMangees, mcts.nbThreads, mcts.totalSimulations / mcts.nbDecisions,
+               mcts.totalSimulations / mcts.dureeTotale);
+    }
+    if (pilote != PILOTE_CLAVIER && ia.nbDecisions > 0) {
+        printf("Autopilote : %d pommes, %ld décisions, %.2f µs en moyenne.\n",
+               p->pommesMangees, ia.nbDecisions, ia.dureeDecisions / ia.nbDecisions);
+    }
+    if (pilote == PILOTE_HAMILTON && hc.nbDecisions > 0) {
+        printf("Cycle hamiltonien : taille %d, %ld décisions (%.2f µs), "
+               "%ld reconstructions (%.2f µs en moyenne).\n",
+               p->tailleSerpent, hc.nbDecisions, hc.dureeDecisions / hc.nbDecisions,
+               hc.nbReconstructions, hc.dureeReconstructions / hc.nbReconstructions);
+    }
 
     return EXIT_SUCCESS;
 }
+#endif
 
 /*****************************************************
 *               FONCTIONS/PROCEDURES                *
 *****************************************************/
 
+/**
+ * @brief Recopie à la suite, tête en premier, les segments d'un serpent
+ * et la queue conservée en segment tailleSerpent.
+ * @param dst Destination, pas forcément alignée.
+ * @param src Partie copiée.
+ */
+static void copierCorps(void *dst, const Partie *src) {
+    int n = src->tailleSerpent + 1;
+    int avant = MAXTAILLESERPENT - src->tete < n ? MAXTAILLESERPENT - src->tete : n;
+    memcpy(dst, &src->corps[src->tete], avant * sizeof(Case));
+    memcpy((char *)dst + avant * sizeof(Case), src->corps, (n - avant) * sizeof(Case));
+}
+
+/**
+ * @brief Copie une partie sans recopier les cases inutilisées du corps.
+ * @param dst Partie de destination (sa tête est remise en corps[0]).
+ * @param src Partie copiée.
+ */
+void copierPartie(Partie *dst, const Partie *src) {
+    memcpy(dst, src, offsetof(Partie, corps));
+    dst->tete = 0;
+    copierCorps(dst->corps, src);
+}
+
+/**
+ * @brief Sauvegarde une partie dans un bloc de taille fixe.
+ * @param p Partie à sauvegarder.
+ * @param sauvegarde Bloc de TAILLESAUVEGARDE octets.
+ *
+ * Les cases inutilisées du corps sont mises à zéro : deux positions
+ * identiques donnent deux sauvegardes identiques. La partie suit
+ * l'en-tête sans être alignée : elle est recopiée octet par octet.
+ */
+void sauvegarderPartie(const Partie *p, unsigned char sauvegarde[TAILLESAUVEGARDE]) {
+    EnteteSauvegarde entete = {
+        .largeur = LARGEURMAX, .hauteur = HAUTEURMAX, .taillePartie = sizeof(Partie)
+    };
+    memcpy(entete.magie, MAGIESAUVEGARDE, sizeof(entete.magie));
+    memset(sauvegarde, 0, TAILLESAUVEGARDE);
+    memcpy(sauvegarde, &entete, sizeof(entete));
+    memcpy(sauvegarde + sizeof(entete), p, offsetof(Partie, corps));
+    copierCorps(sauvegarde + sizeof(entete) + offsetof(Partie, corps), p);
+    /** la génération ne vaut que dans ce processus, la tête est en corps[0] */
+    memset(sauvegarde + sizeof(entete) + offsetof(Partie, generation), 0, sizeof(p->generation));
+    memset(sauvegarde + sizeof(entete) + offsetof(Partie, tete), 0, sizeof(p->tete));
+}
+
+/**
+ * @brief Restaure une partie sauvegardée par sauvegarderPartie().
+ * @param p Partie remplacée.
+ * @param sauvegarde Bloc de TAILLESAUVEGARDE octets.
+ * @return false si le bloc ne vient pas d'un plateau de même taille,
+ * ou si la partie qu'il contient est incohérente (la partie n'est
+ * alors pas modifiée).
+ */
+bool restaurerPartie(Partie *p, const unsigned char sauvegarde[TAILLESAUVEGARDE]) {
+    EnteteSauvegarde entete;
+    memcpy(&entete, sauvegarde, sizeof(entete));
+    if (memcmp(entete.magie, MAGIESAUVEGARDE, sizeof(entete.magie)) != 0 ||
+        entete.largeur != LARGEURMAX || entete.hauteur != HAUTEURMAX ||
+        entete.taillePartie != sizeof(Partie)) {
+        return false;
+    }
+    /** un fichier abîmé ne doit pas faire lire ou copier hors du plateau :
+     * copierPartie() recopie aussi le segment tailleSerpent ; la partie
+     * n'est pas alignée dans le bloc, ses champs sont lus par memcpy */
+    const unsigned char *lue = sauvegarde + sizeof(entete);
+    int taille, tete;
+    char direction;
+    Case c;
+    memcpy(&taille, lue + offsetof(Partie, tailleSerpent), sizeof(taille));
+    memcpy(&tete, lue + offsetof(Partie, tete), sizeof(tete));
+    memcpy(&direction, lue + offsetof(Partie, direction), sizeof(direction));
+    memcpy(&c, lue + offsetof(Partie, posPomme), sizeof(c));
+    if (taille < 1 || taille >= MAXTAILLESERPENT || c >= NBCASES ||
+        tete < 0 || tete >= MAXTAILLESERPENT ||
+        (direction != DROITE && direction != GAUCHE && direction != HAUT && direction != BAS)) {
+        return false;
+    }
+    for (int i = 0; i <= taille; i++) {
+        memcpy(&c, lue + offsetof(Partie, corps) + RANGANNEAU(tete, i) * sizeof(Case), sizeof(c));
+        if (c >= NBCASES) return false;
+    }
+    memcpy(p, lue, sizeof(Partie));
+    p->generation = nouvelleGeneration();
+    return true;
+}
+
+/**
+ * @brief Range l'état courant dans l'anneau, à la place du plus ancien.
+ * @param r Historique.
+ * @param p Partie en cours.
+ */
+void memoriserEtat(Rembobinage *r, const Partie *p) {
+    copierPartie(&r->etats[r->prochain], p);
+    r->prochain = (r->prochain + 1) % MAXREMBOBINAGE;
+    if (r->nb < MAXREMBOBINAGE) r->nb++;
+}
+
+/**
+ * @brief Revient jusqu'à n états en arrière.
+ * @param r Historique (les états retrouvés en sont retirés).
+ * @param p Partie remplacée.
+ * @param n Nombre d'états à remonter.
+ * @return Nombre d'états réellement remontés.
+ */
+int rembobiner(Rembobinage *r, Partie *p, int n) {
+    if (n > r->nb) n = r->nb;
+    if (n <= 0) return 0;
+    r->nb -= n;
+    r->prochain = (r->prochain - n + MAXREMBOBINAGE) % MAXREMBOBINAGE;
+    copierPartie(p, &r->etats[r->prochain]);
+    p->generation = nouvelleGeneration();
+    return n;
+}
+
 /**
  * @brief Efface tous les pavés existants du plateau.
+ * @param p Partie en cours.
  */
-void effacerPaves() {
+void effacerPaves(Partie *p) {
+    p->generation = nouvelleGeneration();
     for (int i = 1; i < HAUTEURMAX-1; i++) {
         for (int j = 1; j < LARGEURMAX-1; j++) {
-            if (plateau[i][j] == CARBORDURE) {
-                plateau[i][j] = VIDE;
+            if (p->plateau[i][j] == CARBORDURE) {
+                p->plateau[i][j] = VIDE;
+                p->empreinte ^= zobrist.pave[CASE(j, i)];
             }
         }
     }
@@ -233,38 +1216,236 @@ void effacer(int x, int y) {
 
 /**
  * @brief Initialise le plateau avec les bordures et les issues.
+ * @param p Partie à initialiser.
  */
-void initPlateau() {
+void initPlateau(Partie *p) {
     /** Double boucle for permettant de se déplacer sur la bordure du tableau 
      * en largeur et en hauteur et afficher la bordure 
-     * sauf si le curseur est au milieu de la bordure
      */
     for (int i = 0; i < HAUTEURMAX; i++) {
         for (int j = 0; j < LARGEURMAX; j++) {
-            if (i == 0 || i == HAUTEURMAX - 1) {
-                plateau[i][j] = (j == LARGEURMAX / 2) ? VIDE : CARBORDURE;
-            } else if (j == 0 || j == LARGEURMAX - 1) {
-                plateau[i][j] = (i == HAUTEURMAX / 2) ? VIDE : CARBORDURE;
+            if (i == 0 || i == HAUTEURMAX - 1 || j == 0 || j == LARGEURMAX - 1) {
+                p->plateau[i][j] = CARBORDURE;
             } else {
-                plateau[i][j] = VIDE;
+                p->plateau[i][j] = VIDE;
+            }
+        }
+    }
+    /** l'entrée de chaque portail est une case vide */
+    for (int k = 0; k < nbPortails; k++) {
+        CASEPLATEAU(p, entreesPortails[k]) = VIDE;
+    }
+}
+
+/**
+ * @brief Mélange les bits d'un entier (finaliseur de splitmix64).
+ * @param x Entier à mélanger.
+ */
+static uint64_t melanger(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+/**
+ * @brief Tire les clés de Zobrist, communes à toutes les parties.
+ */
+void initZobrist() {
+    uint64_t x = GRAINEZOBRIST;
+    uint64_t *cles = (uint64_t *)&zobrist;
+    for (size_t k = 0; k < sizeof(zobrist) / sizeof(uint64_t); k++) {
+        x += 0x9E3779B97F4A7C15ULL;
+        cles[k] = melanger(x);
+    }
+}
+
+/**
+ * @brief Empreinte complète d'une partie, en O(1).
+ * @param p Partie en cours.
+ * @return Hachage du corps, de la tête, de la direction,
+ * de la pomme, des pavés et du nombre de pommes mangées.
+ *
+ * La direction et le compteur de pommes changent hors de progresser() :
+ * ils sont ajoutés ici plutôt que tenus à jour dans p->empreinte.
+ */
+uint64_t empreintePartie(const Partie *p) {
+    return p->empreinte ^ zobrist.direction[(unsigned char)p->direction] ^
+        melanger(GRAINEZOBRIST + (uint64_t)p->pommesMangees);
+}
+
+/**
+ * @brief Recalcule de zéro l'empreinte tenue à jour par progresser(),
+ * placerPaves() et ajouterPomme() (pour la vérifier).
+ * @param p Partie en cours.
+ */
+uint64_t recalculerEmpreinte(Partie *p) {
+    uint64_t e = zobrist.tete[SEGMENT(p, 0)];
+    for (int i = 0; i < p->tailleSerpent; i++) {
+        e ^= zobrist.corps[SEGMENT(p, i)];
+    }
+    if (CASEPLATEAU(p, p->posPomme) == POMME) {
+        e ^= zobrist.pomme[p->posPomme];
+    }
+    for (int i = 1; i < HAUTEURMAX - 1; i++) {
+        for (int j = 1; j < LARGEURMAX - 1; j++) {
+            if (p->plateau[i][j] == CARBORDURE) e ^= zobrist.pave[CASE(j, i)];
+        }
+    }
+    return e;
+}
+
+/**
+ * @brief Prépare la table de redirection des issues,
+ * commune à toutes les parties.
+ */
+void initPortails() {
+    /** Chaque case mène à elle-même tant qu'aucun portail n'y est posé */
+    for (int c = 0; c < NBCASES; c++) {
+        redirection[c] = c;
+    }
+    memset(planIssues, 0, sizeof(planIssues));
+    nbPortails = 0;
+    if (BORDURESOUVERTES) {
+        /** chaque case de bordure renvoie sur la case intérieure opposée */
+        for (int i = 0; i < HAUTEURMAX; i++) {
+            for (int j = 0; j < LARGEURMAX; j++) {
+                if (i != 0 && i != HAUTEURMAX - 1 && j != 0 && j != LARGEURMAX - 1) continue;
+                int x = (j == 0) ? LARGEURMAX - 2 : (j == LARGEURMAX - 1) ? 1 : j;
+                int y = (i == 0) ? HAUTEURMAX - 2 : (i == HAUTEURMAX - 1) ? 1 : i;
+                ajouterPortail(j, i, x, y);
             }
         }
     }
+    for (int k = 0; k < NBPORTAILS; k++) {
+        ajouterPortail(PORTAILS[k].entreeX, PORTAILS[k].entreeY,
+                       PORTAILS[k].sortieX, PORTAILS[k].sortieY);
+    }
+}
+
+/**
+ * @brief Ouvre une issue sur le plateau.
+ * @param entreeX Coordonnée X de la case d'entrée.
+ * @param entreeY Coordonnée Y de la case d'entrée.
+ * @param sortieX Coordonnée X de la case d'arrivée.
+ * @param sortieY Coordonnée Y de la case d'arrivée.
+ *
+ * La case d'entrée sera vide sur les plateaux créés ensuite, et
+ * progresser() la résout en une seule lecture de la table de redirection.
+ */
+void ajouterPortail(int entreeX, int entreeY, int sortieX, int sortieY) {
+    Case entree = CASE(entreeX, entreeY);
+    /** une entrée déjà ouverte change seulement de sortie */
+    int k = 0;
+    while (k < nbPortails && entreesPortails[k] != entree) k++;
+    if (k == nbPortails) nbPortails++;
+    redirection[entree] = CASE(sortieX, sortieY);
+    planIssues[entreeY * LARGEURMAX + entreeX] = 1;
+    entreesPortails[k] = entree;
+    sortiesPortails[k] = CASE(sortieX, sortieY);
+}
+
+/**
+ * @brief Tire un nombre pseudo-aléatoire (xorshift64*).
+ * @param p Partie dont le générateur est utilisé.
+ * @return Entier sur 32 bits.
+ *
+ * Chaque partie a son propre générateur, ce qui rend les parties
+ * copiées indépendantes et reproductibles.
+ */
+uint32_t aleatoire(Partie *p) {
+    p->graine ^= p->graine >> 12;
+    p->graine ^= p->graine << 25;
+    p->graine ^= p->graine >> 27;
+    return (uint32_t)((p->graine * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+/**
+ * @brief Prépare une nouvelle partie : plateau, serpent, pavés et pomme.
+ * @param p Partie à initialiser.
+ * @param graine Graine du générateur aléatoire (non nulle).
+ */
+void initPartie(Partie *p, uint64_t graine) {
+    p->tailleSerpent = TAILLESERPENT;
+    p->direction = DROITE;
+    p->pommesMangees = 0;
+    p->temporisation = TEMPORISATION;
+    p->generation = nouvelleGeneration();
+    p->graine = graine ? graine : 1;
+    p->empreinte = 0;
+    initPlateau(p);
+    /** Le serpent part horizontalement, tête à droite */
+    p->tete = 0;
+    for (int i = 0; i < p->tailleSerpent; i++) {
+        p->corps[i] = CASE(COORDXDEPART - i, COORDYDEPART);
+        CASEPLATEAU(p, SEGMENT(p, i)) = (i == 0) ? TETE : CORPS;
+        p->empreinte ^= zobrist.corps[SEGMENT(p, i)];
+    }
+    p->empreinte ^= zobrist.tete[SEGMENT(p, 0)];
+    placerPaves(p);
+    ajouterPomme(p);
+}
+
+/**
+ * @brief Applique les conséquences d'une pomme mangée :
+ * accélération, croissance, nouvelle pomme et nouveaux pavés.
+ * @param p Partie en cours.
+ * @return false si le plateau est trop rempli pour une nouvelle pomme.
+ */
+bool mangerPomme(Partie *p) {
+    p->pommesMangees++;
+    if (p->temporisation - AUGMENTATIONVITESSE >= TEMPORISATIONMIN) {
+        p->temporisation = p->temporisation - AUGMENTATIONVITESSE;
+    }
+    p->tailleSerpent++;
+    if (!ajouterPomme(p)) {
+        return false;
+    }
+    effacerPaves(p);
+    placerPaves(p);
+    return true;
+}
+
+/**
+ * @brief Indique si une pomme peut être posée sur une case.
+ * @param p Partie en cours.
+ * @param c Case candidate.
+ * @return true si la case est vide, hors portail
+ * (et sur le cycle quand le pilote hamiltonien est actif).
+ */
+static bool pommePossible(Partie *p, Case c) {
+    return CASEPLATEAU(p, c) == VIDE && redirection[c] == c &&
+        (!hc.actif || hc.rang[c] != HORSCYCLE);
 }
 
 /**
  * @brief Place une pomme sur une case vide aléatoire.
+ * @param p Partie en cours.
+ * @return false si plus aucune case ne peut recevoir de pomme.
  */
-void ajouterPomme() {
-    srand(time(NULL));
-    while (plateau[posY_pomme][posX_pomme] != VIDE) {
-        /** génère aléatoirement une coordonnée X */
-        posX_pomme = rand() % (LARGEURMAX - 2) + 1; 
-        /** génère aléatoirment une coordonnées Y */
-        posY_pomme = rand() % (HAUTEURMAX - 2) + 1; 
+bool ajouterPomme(Partie *p) {
+    for (int essai = 0; essai < 4 * NBCASES; essai++) {
+        /** génère aléatoirement une case à l'intérieur des bordures */
+        p->posPomme = CASE(aleatoire(p) % (LARGEURMAX - 2) + 1,
+                        aleatoire(p) % (HAUTEURMAX - 2) + 1);
+        if (pommePossible(p, p->posPomme)) {
+            /** place la pomme si les coordonnées sont valides */
+            CASEPLATEAU(p, p->posPomme) = POMME;
+            p->empreinte ^= zobrist.pomme[p->posPomme];
+            p->generation = nouvelleGeneration();
+            return true;
+        }
     }
-    /** place la pomme si les coordonnées sont valides */
-    plateau[posY_pomme][posX_pomme] = POMME;
+    /** plateau presque plein : on cherche une case libre une à une */
+    for (int c = 0; c < NBCASES; c++) {
+        if (pommePossible(p, c)) {
+            p->posPomme = c;
+            CASEPLATEAU(p, p->posPomme) = POMME;
+            p->empreinte ^= zobrist.pomme[p->posPomme];
+            p->generation = nouvelleGeneration();
+            return true;
+        }
+    }
+    return false;
 }
 
 /**
@@ -274,110 +1455,3045 @@ void ajouterPomme() {
 /**
  * @brief Place des pavés d'obstacles sur le plateau
  * après qu'une pomme a été mangée.
- * @param lesX Tableau des coordonnées X du serpent.
- * @param lesY Tableau des coordonnées Y du serpent.
- * @param direction Direction actuelle du serpent.
+ * @param p Partie en cours.
+ *
+ * Un tirage qui coupe le plateau en plusieurs zones
+ * (pomme ou cases libres inaccessibles depuis la tête)
+ * est effacé puis recommencé ; après MAXTIRAGESPAVES échecs,
+ * un pavé de moins est placé (aucun, au pire : le serpent
+ * seul peut déjà couper le plateau).
  */
-void placerPaves(int lesX[], int lesY[], char direction) {
-    srand(time(NULL));
-    int pavéCount = 0;
+void placerPaves(Partie *p) {
+    int nbPaves = NBREPAVE, tirages = 0;
+    while (nbPaves > 0) {
+        int pavéCount = 0;
 
-    while (pavéCount < NBREPAVE) {
-        int x, y;
-        bool validPosition;
+        while (pavéCount < nbPaves) {
+            int x, y;
+            bool validPosition;
+            int essais = 0;
 
-        do {
-            validPosition = true;
-            x = rand() % (LARGEURMAX - TAILLEPAVE - 2) + 1;
-            y = rand() % (HAUTEURMAX - TAILLEPAVE - 2) + 1;
-
-            // Vérifie que le pavé ne chevauche pas le serpent.
-            for (int i = 0; i < tailleSerpent; i++) {
-                if (x >= lesX[i] && x < lesX[i] + TAILLEPAVE &&
-                    y >= lesY[i] && y < lesY[i] + TAILLEPAVE) {
-                    validPosition = false;
-                    break;
-                }
-            }
+            do {
+                validPosition = true;
+                x = aleatoire(p) % (LARGEURMAX - TAILLEPAVE - 2) + 1;
+                y = aleatoire(p) % (HAUTEURMAX - TAILLEPAVE - 2) + 1;
+
+                // Vérifie que le pavé n'est pas devant la tête du serpent.
+                int headX = CASEX(SEGMENT(p, 0)), headY = CASEY(SEGMENT(p, 0));
+                if (p->direction == DROITE && x >= headX && x < headX + TAILLEPAVE && y == headY) validPosition = false;
+                if (p->direction == GAUCHE && x + TAILLEPAVE > headX && x <= headX && y == headY) validPosition = false;
+                if (p->direction == HAUT && y + TAILLEPAVE > headY && y <= headY && x == headX) validPosition = false;
+                if (p->direction == BAS && y >= headY && y < headY + TAILLEPAVE && x == headX) validPosition = false;
 
-            // Vérifie que le pavé n'est pas devant la tête du serpent.
-            int headX = lesX[0], headY = lesY[0];
-            if (direction == DROITE && x >= headX && x < headX + TAILLEPAVE && y == headY) validPosition = false;
-            if (direction == GAUCHE && x + TAILLEPAVE > headX && x <= headX && y == headY) validPosition = false;
-            if (direction == HAUT && y + TAILLEPAVE > headY && y <= headY && x == headX) validPosition = false;
-            if (direction == BAS && y >= headY && y < headY + TAILLEPAVE && x == headX) validPosition = false;
+                // Vérifie que le pavé ne recouvre ni le serpent, ni la pomme,
+                // ni l'entrée d'un portail.
+                for (int i = 0; i < TAILLEPAVE && validPosition; i++) {
+                    for (int j = 0; j < TAILLEPAVE; j++) {
+                        Case c = CASE(x + j, y + i);
+                        if (redirection[c] != c || CASEPLATEAU(p, c) == CORPS ||
+                            CASEPLATEAU(p, c) == TETE || CASEPLATEAU(p, c) == POMME ||
+                            (hc.actif && caseReservee(c))) {
+                            validPosition = false;
+                        }
+                    }
+                }
 
-            // Vérifie que le pavé n'est pas sur une pomme.
-            if (x == posX_pomme && y == posY_pomme) validPosition = false;
+            } while (!validPosition && ++essais < MAXESSAISPAVE);
 
-        } while (!validPosition);
+            if (!validPosition) break;
 
-        // Place le pavé sur le plateau.
-        for (int i = 0; i < TAILLEPAVE; i++) {
-            for (int j = 0; j < TAILLEPAVE; j++) {
-                plateau[y + i][x + j] = CARBORDURE;
+            // Place le pavé sur le plateau.
+            for (int i = 0; i < TAILLEPAVE; i++) {
+                for (int j = 0; j < TAILLEPAVE; j++) {
+                    /** deux pavés peuvent se chevaucher */
+                    if (p->plateau[y + i][x + j] != CARBORDURE) {
+                        p->empreinte ^= zobrist.pave[CASE(x + j, y + i)];
+                    }
+                    p->plateau[y + i][x + j] = CARBORDURE;
+                }
             }
+            pavéCount++;
+        }
+
+        p->generation = nouvelleGeneration();
+        // Recommence si une partie du plateau est devenue inaccessible.
+        if (plateauConnexe(p, SEGMENT(p, 0))) break;
+        effacerPaves(p);
+        if (++tirages == MAXTIRAGESPAVES) {
+            nbPaves--;
+            tirages = 0;
         }
-        pavéCount++;
     }
 }
 
 /**
  * @brief Dessine le plateau entier avec le serpent et les obstacles.
- * @param lesX Tableau des coordonnées x du serpent.
- * @param lesY Tableau des coordonnées y du serpent.
+ * @param p Partie en cours.
+ * Le serpent est déjà inscrit dans le plateau par progresser().
  */
-void dessinerPlateau(int lesX[], int lesY[]) {
-    /** affiche le serpent dans le terminal */
-    for (int i = 0; i < tailleSerpent; i++) {
-        plateau[lesY[i]][lesX[i]] = (i == 0) ? TETE : CORPS;
-    }
-    system("clear");
+void dessinerPlateau(Partie *p) {
+    dessinerCases(p->plateau);
+}
+
+/**
+ * @brief Efface le terminal et y affiche un plateau.
+ * @param plateau Cases du plateau (celui d'une partie ou d'une image).
+ */
+void dessinerCases(const char plateau[HAUTEURMAX + 1][LARGEURMAX + 1]) {
+    char ligne[LARGEURMAX * 28 + 1];
+    uint8_t couleur = COULEUR_INDIFFERENTE;
+    /** effacement et dessin forment une seule image pour le terminal */
+    fwrite(terminal.debutImage, 1, terminal.tailleDebutImage, stdout);
+    fputs("\033[H\033[2J", stdout);
     /** affiche le plateau déja initialisé dans le terminal de jeu */
     for (int i = 0; i < HAUTEURMAX; i++) {
+        char *o = ligne;
         for (int j = 0; j < LARGEURMAX; j++) {
-            putchar(plateau[i][j]);
+            o = coderCase(o, &couleur, plateau[i][j], i, j);
         }
-        putchar('\n');
+        *o++ = '\n';
+        fwrite(ligne, 1, o - ligne, stdout);
     }
+    fwrite(terminal.sequencesCouleurs[COULEUR_NORMALE], 1, terminal.taillesCouleurs[COULEUR_NORMALE], stdout);
+    fwrite(terminal.finImage, 1, terminal.tailleFinImage, stdout);
 }
 
 /**
- * @brief Fait progresser le serpent d'une étape.
- * @param lesX Tableau des coordonnées X du serpent.
- * @param lesY Tableau des coordonnées Y du serpent.
- * @param direction Direction actuelle du serpent.
+ * @brief Fait progresser le serpent d'une étape dans sa direction.
+ * @param p Partie en cours.
  * @param collision Indique si une collision a été détectée.
  * @param pommeMangee Indique si une pomme a été mangée.
+ *
+ * Le corps est un anneau : la nouvelle tête prend la case qui précède
+ * l'ancienne, sans décaler le corps. L'ancienne queue reste en
+ * segment tailleSerpent : si une pomme est mangée, il suffit
+ * d'incrémenter tailleSerpent pour que le serpent grandisse.
+ * L'empreinte est mise à jour par la tête, la queue et la pomme seulement.
  */
-void progresser(int lesX[], int lesY[], char direction, bool *collision, bool *pommeMangee) {
-    /** effacer le dernier segment du seprent
-     * pour monter qu'il avance
-     */
-    int X = lesX[tailleSerpent - 1];
-    int Y = lesY[tailleSerpent - 1];
-    plateau[Y][X] = VIDE;
-
-    for (int i = tailleSerpent - 1; i > 0; i--) {
-        lesX[i] = lesX[i - 1];
-        lesY[i] = lesY[i - 1];
-    }
-    /** change la coordonnée adéquate du seprent en fonction de la  direction*/
-    if (direction == DROITE) lesX[0]++;
-    if (direction == GAUCHE) lesX[0]--;
-    if (direction == HAUT) lesY[0]--;
-    if (direction == BAS) lesY[0]++;
-
-    /** gestion de la réapparition du seprent 
-     * lorsqu'il emprunte une issue */
-    if (lesX[0] == 0 && lesY[0] == HAUTEURMAX / 2) lesX[0] = LARGEURMAX - 2;
-    else if (lesX[0] == LARGEURMAX - 1 && lesY[0] == HAUTEURMAX / 2) lesX[0] = 1;
-    else if (lesY[0] == 0 && lesX[0] == LARGEURMAX / 2) lesY[0] = HAUTEURMAX - 2;
-    else if (lesY[0] == HAUTEURMAX - 1 && lesX[0] == LARGEURMAX / 2) lesY[0] = 1;
-
-    *collision = plateau[lesY[0]][lesX[0]] == CARBORDURE || 
-        plateau[lesY[0]][lesX[0]] == CORPS;
-    *pommeMangee = (lesX[0] == posX_pomme && lesY[0] == posY_pomme);
+void progresser(Partie *p, bool *collision, bool *pommeMangee) {
+    /** nouvelle tête : décalage précalculé de la direction,
+     * puis passage éventuel par une issue */
+    Case ancienne = SEGMENT(p, 0);
+    Case tete = redirection[ancienne + DELTA[(unsigned char)p->direction]];
+
+    *pommeMangee = (tete == p->posPomme);
+    /** effacer le dernier segment du serpent
+     * pour montrer qu'il avance */
+    if (!*pommeMangee) {
+        Case queue = SEGMENT(p, p->tailleSerpent - 1);
+        CASEPLATEAU(p, queue) = VIDE;
+        p->empreinte ^= zobrist.corps[queue];
+    } else {
+        p->empreinte ^= zobrist.pomme[tete];
+    }
+    p->empreinte ^= zobrist.tete[ancienne] ^ zobrist.tete[tete] ^ zobrist.corps[tete];
+    *collision = CASEPLATEAU(p, tete) == CARBORDURE ||
+        CASEPLATEAU(p, tete) == CORPS;
+
+    p->tete = p->tete == 0 ? MAXTAILLESERPENT - 1 : p->tete - 1;
+    p->corps[p->tete] = tete;
+    CASEPLATEAU(p, ancienne) = CORPS;
+    CASEPLATEAU(p, tete) = TETE;
+}
+
+/*****************************************************
+*          PARCOURS DU PLATEAU PAR BITBOARDS         *
+*****************************************************/
+
+/**
+ * @brief Construit l'ensemble des cases où le serpent peut se trouver.
+ * @param p Partie en cours.
+ * @param libres Bitboard à remplir.
+ * @param corpsLibre Si vrai, les cases du serpent comptent comme libres
+ * (elles le redeviendront quand il aura avancé).
+ *
+ * Les bordures, les pavés et les entrées de portails sont exclus :
+ * on ne s'arrête jamais sur une entrée, on arrive sur sa sortie.
+ */
+void casesLibres(Partie *p, Bitboard *libres, bool corpsLibre) {
+    memset(libres, 0, sizeof(*libres));
+    for (int i = 0; i < HAUTEURMAX; i++) {
+        for (int j = 0; j < LARGEURMAX; j++) {
+            char c = p->plateau[i][j];
+            if (c == CARBORDURE || (!corpsLibre && (c == CORPS || c == TETE))) {
+                continue;
+            }
+            libres->ligne[i][j / 64] |= (uint64_t)1 << (j % 64);
+        }
+    }
+    for (int k = 0; k < nbPortails; k++) {
+        Case e = entreesPortails[k];
+        libres->ligne[CASEY(e)][CASEX(e) / 64] &= ~((uint64_t)1 << (CASEX(e) % 64));
+    }
+}
+
+/**
+ * @brief Calcule la couche suivante d'un parcours en largeur,
+ * toutes les cases d'une ligne étant traitées en parallèle.
+ * @param front Cases atteintes à la dernière couche.
+ * @param vus Cases déjà atteintes.
+ * @param libres Cases autorisées.
+ * @param inverse Si vrai, on cherche les cases d'où l'on atteint front
+ * en un déplacement (parcours depuis une cible), sinon celles
+ * atteintes depuis front.
+ * @param suivant Nouvelle couche (cases libres non encore vues).
+ * @return Nombre de cases de la nouvelle couche.
+ */
+int coucheSuivante(const Bitboard *front, const Bitboard *vus,
+                   const Bitboard *libres, bool inverse, Bitboard *suivant) {
+    static _Thread_local Bitboard source;
+    const Bitboard *f = front;
+
+    /** en sens inverse, une sortie atteinte rend atteignables
+     * les voisins de l'entrée correspondante */
+    if (inverse && nbPortails > 0) {
+        source = *front;
+        for (int k = 0; k < nbPortails; k++) {
+            Case s = sortiesPortails[k], e = entreesPortails[k];
+            if (front->ligne[CASEY(s)][CASEX(s) / 64] >> (CASEX(s) % 64) & 1) {
+                source.ligne[CASEY(e)][CASEX(e) / 64] |= (uint64_t)1 << (CASEX(e) % 64);
+            }
+        }
+        f = &source;
+    }
+
+    /** décalage d'un bit à gauche et à droite (avec retenue entre mots),
+     * plus les lignes du dessus et du dessous */
+    for (int i = 0; i < HAUTEURMAX; i++) {
+        for (int w = 0; w < MOTSLIGNE; w++) {
+            uint64_t m = f->ligne[i][w];
+            uint64_t v = (m << 1) | (m >> 1);
+            if (w > 0) v |= f->ligne[i][w - 1] >> 63;
+            if (w < MOTSLIGNE - 1) v |= f->ligne[i][w + 1] << 63;
+            if (i > 0) v |= f->ligne[i - 1][w];
+            if (i < HAUTEURMAX - 1) v |= f->ligne[i + 1][w];
+            suivant->ligne[i][w] = v;
+        }
+    }
+
+    /** en sens direct, atteindre une entrée revient à atteindre sa sortie */
+    if (!inverse) {
+        for (int k = 0; k < nbPortails; k++) {
+            Case s = sortiesPortails[k], e = entreesPortails[k];
+            if (suivant->ligne[CASEY(e)][CASEX(e) / 64] >> (CASEX(e) % 64) & 1) {
+                suivant->ligne[CASEY(s)][CASEX(s) / 64] |= (uint64_t)1 << (CASEX(s) % 64);
+            }
+        }
+    }
+
+    int nb = 0;
+    for (int i = 0; i < HAUTEURMAX; i++) {
+        for (int w = 0; w < MOTSLIGNE; w++) {
+            suivant->ligne[i][w] &= libres->ligne[i][w] & ~vus->ligne[i][w];
+            nb += __builtin_popcountll(suivant->ligne[i][w]);
+        }
+    }
+    return nb;
+}
+
+/**
+ * @brief Vérifie que toutes les cases libres (pomme comprise)
+ * sont accessibles depuis une case de départ.
+ * @param p Partie en cours.
+ * @param depart Case de départ, en général la tête du serpent.
+ * @return true si le plateau forme une seule zone.
+ */
+bool plateauConnexe(Partie *p, Case depart) {
+    casesLibres(p, &bbLibres, true);
+    memset(&bbVus, 0, sizeof(bbVus));
+    memset(&bbFront, 0, sizeof(bbFront));
+    bbFront.ligne[CASEY(depart)][CASEX(depart) / 64] |= (uint64_t)1 << (CASEX(depart) % 64);
+    bbVus = bbFront;
+
+    int atteintes = 1;
+    int nb;
+    while ((nb = coucheSuivante(&bbFront, &bbVus, &bbLibres, false, &bbSuivant)) > 0) {
+        atteintes += nb;
+        for (int i = 0; i < HAUTEURMAX; i++) {
+            for (int w = 0; w < MOTSLIGNE; w++) {
+                bbVus.ligne[i][w] |= bbSuivant.ligne[i][w];
+            }
+        }
+        bbFront = bbSuivant;
+    }
+
+    int libres = 0;
+    for (int i = 0; i < HAUTEURMAX; i++) {
+        for (int w = 0; w < MOTSLIGNE; w++) {
+            libres += __builtin_popcountll(bbLibres.ligne[i][w]);
+        }
+    }
+    return atteintes == libres;
+}
+
+/**
+ * @brief Recalcule la carte des distances à la pomme,
+ * couche par couche en partant de la pomme.
+ * @param p Partie en cours.
+ */
+void calculerDistancePomme(Partie *p) {
+    for (int c = 0; c < NBCASES; c++) {
+        distancePomme[c] = INACCESSIBLE;
+    }
+    casesLibres(p, &bbLibres, true);
+    memset(&bbFront, 0, sizeof(bbFront));
+    bbFront.ligne[CASEY(p->posPomme)][CASEX(p->posPomme) / 64] |= (uint64_t)1 << (CASEX(p->posPomme) % 64);
+    bbVus = bbFront;
+    distancePomme[p->posPomme] = 0;
+
+    for (uint16_t d = 1; coucheSuivante(&bbFront, &bbVus, &bbLibres, true, &bbSuivant) > 0; d++) {
+        for (int i = 0; i < HAUTEURMAX; i++) {
+            for (int w = 0; w < MOTSLIGNE; w++) {
+                uint64_t m = bbSuivant.ligne[i][w];
+                bbVus.ligne[i][w] |= m;
+                /** parcourt les bits à 1 de la couche */
+                while (m) {
+                    distancePomme[CASE(w * 64 + __builtin_ctzll(m), i)] = d;
+                    m &= m - 1;
+                }
+            }
+        }
+        bbFront = bbSuivant;
+    }
+    generationDistance = p->generation;
+}
+
+/**
+ * @brief Distance (en déplacements) d'une case à la pomme.
+ * @param p Partie en cours.
+ * @param c Case de départ.
+ * @return Nombre de déplacements, ou INACCESSIBLE.
+ *
+ * La carte n'est recalculée que si elle a été calculée pour une
+ * autre partie, ou avant que la pomme ou les pavés ne changent.
+ */
+int distanceALaPomme(Partie *p, Case c) {
+    if (p->generation != generationDistance) {
+        calculerDistancePomme(p);
+    }
+    return distancePomme[c];
+}
+
+/*****************************************************
+*                    AUTOPILOTE                      *
+*****************************************************/
+
+/**
+ * @brief Prépare l'autopilote pour une nouvelle partie.
+ */
+void initAutopilote() {
+    memset(&ia, 0, sizeof(ia));
+    ia.pommeVisee = NBCASES - 1;
+}
+
+/**
+ * @brief Ajoute une case dans la file de priorité de l'autopilote.
+ * @param n Nombre d'éléments de la file (mis à jour).
+ * @param f Priorité (plus petit d'abord).
+ * @param c Case.
+ */
+static void empiler(int *n, uint32_t f, Case c) {
+    int i = (*n)++;
+    uint64_t v = ((uint64_t)f << 32) | c;
+    while (i > 0 && ia.tas[(i - 1) / 2] > v) {
+        ia.tas[i] = ia.tas[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    ia.tas[i] = v;
+}
+
+/**
+ * @brief Retire la case de plus petite priorité de la file.
+ * @param n Nombre d'éléments de la file (mis à jour).
+ * @return La case retirée.
+ */
+static Case depiler(int *n) {
+    uint64_t sommet = ia.tas[0];
+    uint64_t dernier = ia.tas[--(*n)];
+    int i = 0;
+    while (2 * i + 1 < *n) {
+        int e = 2 * i + 1;
+        if (e + 1 < *n && ia.tas[e + 1] < ia.tas[e]) e++;
+        if (ia.tas[e] >= dernier) break;
+        ia.tas[i] = ia.tas[e];
+        i = e;
+    }
+    ia.tas[i] = dernier;
+    return (Case)(sommet & 0xFFFFFFFF);
+}
+
+/**
+ * @brief Cherche un chemin sûr de la tête vers une cible (A*).
+ * @param p Partie en cours.
+ * @param corpsS Anneau des cases du serpent.
+ * @param teteS Indice de la tête dans corpsS.
+ * @param taille Nombre de cases du serpent.
+ * @param cible Case à atteindre.
+ * @param versPomme Si vrai, la carte des distances à la pomme
+ * sert d'heuristique, sinon le parcours est un simple parcours en largeur.
+ * @param dirs Touches à jouer, remplies depuis la tête.
+ * @return Longueur du chemin, ou -1 s'il n'y en a pas.
+ *
+ * Une case du corps est franchissable dès que la queue l'a libérée :
+ * le segment i disparaît après (taille - i) déplacements.
+ */
+int chercherChemin(Partie *p, const Case corpsS[], int teteS, int taille, Case cible, bool versPomme, char dirs[]) {
+    char touches[4] = {DROITE, GAUCHE, HAUT, BAS};
+    uint32_t t = ++ia.tour;
+    int n = 0;
+
+    if (versPomme && p->generation != generationDistance) {
+        calculerDistancePomme(p);
+    }
+    for (int i = 0; i < taille; i++) {
+        Case c = corpsS[RANGANNEAU(teteS, i)];
+        ia.occupe[c] = t;
+        ia.libereApres[c] = taille - i;
+    }
+
+    Case tete = corpsS[teteS];
+    ia.vu[tete] = t;
+    ia.g[tete] = 0;
+    empiler(&n, 0, tete);
+
+    while (n > 0) {
+        Case c = depiler(&n);
+        if (ia.ferme[c] == t) continue;
+        ia.ferme[c] = t;
+
+        if (c == cible) {
+            /** remonte le chemin depuis la cible */
+            int longueur = ia.g[c];
+            for (int k = longueur - 1; k >= 0; k--) {
+                dirs[k] = ia.dirVenant[c];
+                c = ia.venant[c];
+            }
+            return longueur;
+        }
+
+        for (int d = 0; d < 4; d++) {
+            Case v = redirection[c + DELTA[(unsigned char)touches[d]]];
+            uint16_t g = ia.g[c] + 1;
+            if (CASEPLATEAU(p, v) == CARBORDURE) continue;
+            if (ia.occupe[v] == t && ia.libereApres[v] > g) continue;
+            if (ia.vu[v] == t && ia.g[v] <= g) continue;
+            uint32_t h = 0;
+            if (versPomme) {
+                if (distancePomme[v] == INACCESSIBLE) continue;
+                h = distancePomme[v];
+            }
+            ia.vu[v] = t;
+            ia.g[v] = g;
+            ia.venant[v] = c;
+            ia.dirVenant[v] = touches[d];
+            empiler(&n, g + h, v);
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Vérifie qu'après avoir suivi ia.chemin jusqu'à la pomme,
+ * le serpent (allongé d'une case) peut encore rejoindre sa queue.
+ * @param p Partie en cours.
+ * @param corpsS Anneau des cases du serpent.
+ * @param teteS Indice de la tête dans corpsS.
+ * @param taille Nombre de cases du serpent.
+ * @param longueur Longueur de ia.chemin.
+ * @return true si le chemin ne mène pas dans une impasse.
+ */
+bool cheminSur(Partie *p, const Case corpsS[], int teteS, int taille, int longueur) {
+    int tailleV = (taille + 1 < MAXTAILLESERPENT) ? taille + 1 : MAXTAILLESERPENT;
+    Case c = corpsS[teteS];
+
+    /** la k-ième case du chemin devient le segment (longueur - k),
+     * l'ancien corps suit derrière l'ancienne tête */
+    for (int k = 0; k <= longueur; k++) {
+        if (longueur - k < tailleV) ia.corpsVirtuel[longueur - k] = c;
+        if (k < longueur) c = redirection[c + DELTA[(unsigned char)ia.chemin[k]]];
+    }
+    for (int i = longueur + 1; i < tailleV; i++) {
+        ia.corpsVirtuel[i] = corpsS[RANGANNEAU(teteS, i - longueur)];
+    }
+    return chercherChemin(p, ia.corpsVirtuel, 0, tailleV, ia.corpsVirtuel[tailleV - 1],
+                          false, ia.essai) > 0;
+}
+
+/**
+ * @brief Choisit la touche à jouer à la place du joueur.
+ * @param p Partie en cours.
+ * @return Touche de direction à jouer.
+ *
+ * Suit un chemin sûr vers la pomme, recalculé seulement quand
+ * la pomme a changé ; à défaut, poursuit sa queue pour survivre.
+ */
+char decisionAutopilote(Partie *p) {
+    struct timespec debut, fin;
+    char touche = 0;
+    clock_gettime(CLOCK_MONOTONIC, &debut);
+
+    /** le chemin en cours reste valable tant que la pomme n'a pas bougé */
+    if (ia.pommeVisee == p->posPomme && ia.suivant < ia.longueur) {
+        touche = ia.chemin[ia.suivant++];
+    } else {
+        ia.pommeVisee = NBCASES - 1;
+        ia.longueur = chercherChemin(p, p->corps, p->tete, p->tailleSerpent, p->posPomme, true, ia.chemin);
+        if (ia.longueur > 0 && cheminSur(p, p->corps, p->tete, p->tailleSerpent, ia.longueur)) {
+            ia.pommeVisee = p->posPomme;
+            ia.suivant = 1;
+            touche = ia.chemin[0];
+        } else if (chercherChemin(p, p->corps, p->tete, p->tailleSerpent, SEGMENT(p, p->tailleSerpent - 1),
+                                  false, ia.essai) > 0) {
+            /** pas de chemin sûr : suivre sa queue */
+            touche = ia.essai[0];
+        } else {
+            /** dernier recours : n'importe quelle case libre */
+            char touches[4] = {DROITE, GAUCHE, HAUT, BAS};
+            touche = p->direction;
+            for (int d = 0; d < 4; d++) {
+                char v = CASEPLATEAU(p, redirection[SEGMENT(p, 0) + DELTA[(unsigned char)touches[d]]]);
+                if (v == VIDE || v == POMME) {
+                    touche = touches[d];
+                    break;
+                }
+            }
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &fin);
+    ia.nbDecisions++;
+    ia.dureeDecisions += (fin.tv_sec - debut.tv_sec) * 1e6 + (fin.tv_nsec - debut.tv_nsec) / 1e3;
+    return touche;
+}
+
+/*****************************************************
+*              PILOTE HAMILTONIEN                    *
+*****************************************************/
+
+/**
+ * @brief Indique si les quatre cases d'un bloc 2x2 sont praticables.
+ * @param p Partie en cours.
+ * @param b Numéro du bloc.
+ */
+static bool blocLibre(Partie *p, int b) {
+    int x = 1 + 2 * (b % BLOCSX), y = 1 + 2 * (b / BLOCSX);
+    for (int i = 0; i < 2; i++) {
+        for (int j = 0; j < 2; j++) {
+            Case c = CASE(x + j, y + i);
+            if (CASEPLATEAU(p, c) == CARBORDURE || redirection[c] != c) return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Numéro du bloc 2x2 contenant une case, -1 en dehors des blocs.
+ */
+static int blocDeCase(Case c) {
+    int x = CASEX(c) - 1, y = CASEY(c) - 1;
+    if (x < 0 || y < 0 || x >= 2 * BLOCSX || y >= 2 * BLOCSY) return -1;
+    return x / 2 + (y / 2) * BLOCSX;
+}
+
+/**
+ * @brief Blocs voisins d'un bloc (droite, gauche, dessous, dessus),
+ * -1 au bord de l'intérieur.
+ */
+static void blocsVoisins(int b, int voisins[4]) {
+    int bx = b % BLOCSX, by = b / BLOCSX;
+    voisins[0] = bx + 1 < BLOCSX ? b + 1 : -1;
+    voisins[1] = bx > 0 ? b - 1 : -1;
+    voisins[2] = by + 1 < BLOCSY ? b + BLOCSX : -1;
+    voisins[3] = by > 0 ? b - BLOCSX : -1;
+}
+
+/**
+ * @brief Indique si deux blocs voisins sont reliés dans l'arbre.
+ */
+static bool blocsRelies(int a, int b) {
+    if (b == a + 1) return hc.aretes[a] & 1;
+    if (b == a - 1) return hc.aretes[b] & 1;
+    if (b == a + BLOCSX) return hc.aretes[a] & 2;
+    return hc.aretes[b] & 2;
+}
+
+/**
+ * @brief Parcourt en largeur les blocs libres reliés à un bloc.
+ * @param p Partie en cours.
+ * @param depart Bloc de départ.
+ * @param num Numéro donné à la composante.
+ * @return Nombre de blocs de la composante.
+ */
+static int parcourirBlocs(Partie *p, int depart, int num) {
+    int debut = 0, fin = 0, voisins[4];
+    hc.file[fin++] = depart;
+    hc.composante[depart] = num;
+    while (debut < fin) {
+        blocsVoisins(hc.file[debut++], voisins);
+        for (int k = 0; k < 4; k++) {
+            int v = voisins[k];
+            if (v < 0 || hc.composante[v] != 0 || !blocLibre(p, v)) continue;
+            hc.composante[v] = num;
+            hc.file[fin++] = v;
+        }
+    }
+    return fin;
+}
+
+/**
+ * @brief Étend l'arbre couvrant depuis un bloc, en gardant
+ * les arêtes de l'arbre précédent.
+ * @param p Partie en cours.
+ * @param depart Bloc de départ.
+ *
+ * Les blocs reliés par une arête conservée sont ajoutés d'un seul
+ * tenant ; une nouvelle arête n'est créée que vers un bloc encore
+ * hors de l'arbre. Les cases déjà sur le cycle gardent ainsi
+ * leur ordre : le cycle ne fait que perdre ou gagner des détours.
+ */
+static void etendreArbre(Partie *p, int depart) {
+    int debut = 0, fin = 0, prochain = 0, voisins[4];
+    hc.file[fin++] = depart;
+    hc.composante[depart] = 1;
+    for (;;) {
+        /** d'abord tout ce que relient les arêtes conservées */
+        while (debut < fin) {
+            int b = hc.file[debut++];
+            blocsVoisins(b, voisins);
+            for (int k = 0; k < 4; k++) {
+                int v = voisins[k];
+                if (v < 0 || hc.composante[v] != 0 || !blocsRelies(b, v)) continue;
+                hc.composante[v] = 1;
+                hc.file[fin++] = v;
+            }
+        }
+        /** puis une nouvelle arête vers un bloc libre voisin */
+        int nouveau = -1;
+        for (; prochain < fin && nouveau < 0; prochain++) {
+            int b = hc.file[prochain];
+            blocsVoisins(b, voisins);
+            for (int k = 0; k < 4 && nouveau < 0; k++) {
+                int v = voisins[k];
+                if (v < 0 || hc.composante[v] != 0 || !blocLibre(p, v)) continue;
+                hc.aretes[k == 0 ? b : k == 1 ? v : k == 2 ? b : v] |= k < 2 ? 1 : 2;
+                nouveau = v;
+            }
+        }
+        if (nouveau < 0) break;
+        /** le bloc peut encore avoir d'autres voisins libres */
+        prochain--;
+        hc.composante[nouveau] = 1;
+        hc.file[fin++] = nouveau;
+    }
+}
+
+/**
+ * @brief Distance en avançant sur le cycle d'une case à une autre.
+ */
+static int distanceCycle(Case de, Case a) {
+    int d = (int)hc.rang[a] - (int)hc.rang[de];
+    return d < 0 ? d + hc.longueur : d;
+}
+
+/**
+ * @brief Indique si le corps est rangé dans l'ordre du cycle,
+ * de la queue vers la tête (des cases libres peuvent les séparer).
+ * @param p Partie en cours.
+ */
+static bool corpsRange(Partie *p) {
+    int precedente = 0;
+    for (int i = 0; i < p->tailleSerpent; i++) {
+        if (hc.rang[SEGMENT(p, i)] == HORSCYCLE) return false;
+        int d = distanceCycle(SEGMENT(p, i), SEGMENT(p, 0));
+        if (i > 0 && d <= precedente) return false;
+        precedente = d;
+    }
+    return true;
+}
+
+/**
+ * @brief Reconstruit le cycle hamiltonien après un changement de pavés.
+ * @param p Partie en cours.
+ *
+ * L'intérieur est découpé en blocs 2x2 ; chaque bloc libre est une
+ * petite boucle, et un arbre couvrant de la zone de blocs libres
+ * de la tête (ou de la plus grande) les fusionne en un seul cycle.
+ * Les cases des blocs entamés par un pavé restent hors du cycle.
+ */
+void construireCycle(Partie *p) {
+    struct timespec debut, fin;
+    clock_gettime(CLOCK_MONOTONIC, &debut);
+
+    for (int c = 0; c < NBCASES; c++) {
+        hc.rang[c] = HORSCYCLE;
+    }
+    memset(hc.composante, 0, sizeof(hc.composante));
+
+    /** oublie les arêtes qui touchent un bloc qui n'est plus libre */
+    for (int b = 0; b < BLOCSX * BLOCSY; b++) {
+        int voisins[4];
+        blocsVoisins(b, voisins);
+        if (!blocLibre(p, b)) {
+            hc.aretes[b] = 0;
+            continue;
+        }
+        if (voisins[0] < 0 || !blocLibre(p, voisins[0])) hc.aretes[b] &= ~1;
+        if (voisins[2] < 0 || !blocLibre(p, voisins[2])) hc.aretes[b] &= ~2;
+    }
+
+    /** part du bloc de la tête, sinon de la plus grande zone de blocs libres */
+    int meilleur = blocDeCase(SEGMENT(p, 0));
+    if (meilleur < 0 || !blocLibre(p, meilleur)) {
+        int tailleMax = 0, num = 0;
+        meilleur = -1;
+        for (int b = 0; b < BLOCSX * BLOCSY; b++) {
+            if (hc.composante[b] != 0 || !blocLibre(p, b)) continue;
+            int t = parcourirBlocs(p, b, ++num);
+            if (t > tailleMax) {
+                tailleMax = t;
+                meilleur = b;
+            }
+        }
+        memset(hc.composante, 0, sizeof(hc.composante));
+    }
+    hc.longueur = 0;
+    hc.actif = true;
+    if (meilleur < 0) return;
+    etendreArbre(p, meilleur);
+
+    /** boucle de chaque bloc, tournant dans le sens trigonométrique,
+     * puis chaque arête de l'arbre fusionne deux boucles */
+    for (int b = 0; b < BLOCSX * BLOCSY; b++) {
+        int x = 1 + 2 * (b % BLOCSX), y = 1 + 2 * (b / BLOCSX);
+        hc.suivante[CASE(x, y)] = BAS;
+        hc.suivante[CASE(x, y + 1)] = DROITE;
+        hc.suivante[CASE(x + 1, y + 1)] = HAUT;
+        hc.suivante[CASE(x + 1, y)] = GAUCHE;
+    }
+    for (int b = 0; b < BLOCSX * BLOCSY; b++) {
+        if (hc.composante[b] == 0) continue;
+        int x = 1 + 2 * (b % BLOCSX), y = 1 + 2 * (b / BLOCSX);
+        if (hc.aretes[b] & 1) {          /* bloc de droite */
+            hc.suivante[CASE(x + 1, y + 1)] = DROITE;
+            hc.suivante[CASE(x + 2, y)] = GAUCHE;
+        }
+        if (hc.aretes[b] & 2) {          /* bloc du dessous */
+            hc.suivante[CASE(x, y + 1)] = BAS;
+            hc.suivante[CASE(x + 1, y + 2)] = HAUT;
+        }
+    }
+
+    /** numérote les cases en suivant le cycle */
+    Case depart = CASE(1 + 2 * (meilleur % BLOCSX), 1 + 2 * (meilleur / BLOCSX));
+    Case c = depart;
+    do {
+        hc.rang[c] = hc.longueur++;
+        c += DELTA[(unsigned char)hc.suivante[c]];
+    } while (c != depart);
+
+    /** si le corps n'est plus dans l'ordre du nouveau cycle,
+     * chaque pas sera vérifié jusqu'à ce qu'il le soit */
+    hc.prudence = corpsRange(p) ? 0 : p->tailleSerpent;
+
+    clock_gettime(CLOCK_MONOTONIC, &fin);
+    hc.nbReconstructions++;
+    hc.dureeReconstructions += (fin.tv_sec - debut.tv_sec) * 1e6 + (fin.tv_nsec - debut.tv_nsec) / 1e3;
+}
+
+/**
+ * @brief Interdit aux prochains pavés les blocs qui portent le corps,
+ * ainsi que ceux qui les relient dans l'arbre.
+ * @param p Partie en cours.
+ *
+ * Appelée avant que les pavés ne changent : l'arbre garde alors
+ * les arêtes sous le serpent, et son corps reste dans l'ordre du cycle.
+ */
+void reserverCycle(Partie *p) {
+    int racine = blocDeCase(SEGMENT(p, 0));
+    memset(hc.reserve, 0, sizeof(hc.reserve));
+    if (racine < 0 || hc.composante[racine] == 0) return;
+
+    /** enracine l'arbre sur le bloc de la tête */
+    int debut = 0, fin = 0, voisins[4];
+    for (int b = 0; b < BLOCSX * BLOCSY; b++) {
+        hc.parent[b] = -2;
+    }
+    hc.file[fin++] = racine;
+    hc.parent[racine] = -1;
+    while (debut < fin) {
+        int b = hc.file[debut++];
+        blocsVoisins(b, voisins);
+        for (int k = 0; k < 4; k++) {
+            int v = voisins[k];
+            if (v < 0 || hc.parent[v] != -2 || !blocsRelies(b, v)) continue;
+            hc.parent[v] = b;
+            hc.file[fin++] = v;
+        }
+    }
+
+    /** chemins de chaque segment jusqu'à la tête, y compris
+     * la queue conservée en segment tailleSerpent par une pomme */
+    for (int i = 0; i <= p->tailleSerpent; i++) {
+        int b = blocDeCase(SEGMENT(p, i));
+        if (b < 0 || hc.parent[b] == -2) continue;
+        while (b >= 0 && !hc.reserve[b]) {
+            hc.reserve[b] = true;
+            b = hc.parent[b];
+        }
+    }
+}
+
+/**
+ * @brief Indique si une case appartient à un bloc réservé au cycle.
+ */
+bool caseReservee(Case c) {
+    int b = blocDeCase(c);
+    return b >= 0 && hc.reserve[b];
+}
+
+/**
+ * @brief Déplace la pomme sur le cycle si elle se trouve en dehors.
+ * @param p Partie en cours.
+ * @return false si aucune case du cycle ne peut la recevoir.
+ */
+bool placerPommeSurCycle(Partie *p) {
+    if (hc.rang[p->posPomme] != HORSCYCLE) return true;
+    CASEPLATEAU(p, p->posPomme) = VIDE;
+    p->empreinte ^= zobrist.pomme[p->posPomme];
+    return ajouterPomme(p);
+}
+
+/**
+ * @brief Vérifie, segment par segment, qu'en suivant le cycle depuis
+ * une case, le serpent n'atteint chaque segment qu'après son départ.
+ * @param p Partie en cours.
+ * @param c Case où la tête va entrer.
+ */
+static bool suiviSur(Partie *p, Case c) {
+    for (int i = 1; i < p->tailleSerpent; i++) {
+        if (hc.rang[SEGMENT(p, i)] == HORSCYCLE) continue;
+        /** marge de deux pommes mangées en route */
+        if (distanceCycle(c, SEGMENT(p, i)) + 1 < p->tailleSerpent - i + 2) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Choisit la touche à jouer en suivant le cycle hamiltonien.
+ * @param p Partie en cours.
+ * @return Touche de direction à jouer.
+ *
+ * Quand le corps est rangé dans l'ordre du cycle, la décision est en
+ * O(1) : case suivante du cycle, ou raccourci vers la pomme qui ne
+ * dépasse pas la queue tant que le serpent est court. Juste après une
+ * reconstruction, chaque pas est vérifié segment par segment, et
+ * l'autopilote A* prend le relais si la tête est hors du cycle.
+ */
+char decisionHamilton(Partie *p) {
+    struct timespec debut, fin;
+    char touche;
+    Case tete = SEGMENT(p, 0);
+    clock_gettime(CLOCK_MONOTONIC, &debut);
+
+    char touches[4] = {DROITE, GAUCHE, HAUT, BAS};
+
+    if (hc.rang[tete] == HORSCYCLE || hc.prudence > 0) {
+        /** case suivante du cycle si on peut la suivre sans risque,
+         * sinon n'importe quelle case voisine du cycle qui le permet */
+        touche = 0;
+        if (hc.rang[tete] != HORSCYCLE &&
+            suiviSur(p, tete + DELTA[(unsigned char)hc.suivante[tete]])) {
+            touche = hc.suivante[tete];
+            hc.prudence--;
+        } else {
+            for (int d = 0; d < 4 && touche == 0; d++) {
+                Case v = redirection[tete + DELTA[(unsigned char)touches[d]]];
+                if (hc.rang[v] == HORSCYCLE) continue;
+                if (CASEPLATEAU(p, v) != VIDE && CASEPLATEAU(p, v) != POMME) continue;
+                if (directionValide(touches[d], p->direction) && suiviSur(p, v)) {
+                    touche = touches[d];
+                }
+            }
+            hc.prudence = p->tailleSerpent;
+        }
+        if (touche == 0) {
+            /** rien de sûr sur le cycle : l'autopilote prend le relais */
+            ia.pommeVisee = NBCASES - 1;
+            touche = decisionAutopilote(p);
+        }
+    } else {
+        int versQueue = distanceCycle(tete, SEGMENT(p, p->tailleSerpent - 1));
+        int versPomme = distanceCycle(tete, p->posPomme);
+        touche = hc.suivante[tete];
+        if (p->tailleSerpent * 100 < hc.longueur * RACCOURCISJUSQUA) {
+            /** plus grand saut qui ne dépasse ni la pomme ni la queue */
+            int meilleur = 1;
+            for (int d = 0; d < 4; d++) {
+                Case v = redirection[tete + DELTA[(unsigned char)touches[d]]];
+                if (hc.rang[v] == HORSCYCLE) continue;
+                if (CASEPLATEAU(p, v) != VIDE && CASEPLATEAU(p, v) != POMME) continue;
+                int saut = distanceCycle(tete, v);
+                if (saut > meilleur && saut <= versPomme && saut < versQueue - 3) {
+                    meilleur = saut;
+                    touche = touches[d];
+                }
+            }
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &fin);
+    hc.nbDecisions++;
+    hc.dureeDecisions += (fin.tv_sec - debut.tv_sec) * 1e6 + (fin.tv_nsec - debut.tv_nsec) / 1e3;
+    return touche;
+}
+
+/*****************************************************
+*              JOUEUR MONTE-CARLO                    *
+*****************************************************/
+
+/**
+ * @brief Tire un nombre pseudo-aléatoire pour un thread de recherche.
+ * @param graine État du générateur (xorshift64).
+ */
+static uint32_t aleatoireMCTS(uint64_t *graine) {
+    *graine ^= *graine << 13;
+    *graine ^= *graine >> 7;
+    *graine ^= *graine << 17;
+    return (uint32_t)(*graine >> 32);
+}
+
+/**
+ * @brief Indique si la tête peut entrer sans danger dans une case
+ * (la queue, qui va se libérer, compte comme libre).
+ */
+static bool caseSure(const Partie *p, Case c) {
+    char v = CASEPLATEAU(p, c);
+    return v == VIDE || v == POMME || c == SEGMENT(p, p->tailleSerpent - 1);
+}
+
+/**
+ * @brief Joue un déplacement dans la partie simulée d'un thread.
+ * @param r Recherche du thread.
+ * @param touche Touche jouée (déjà valide).
+ * @return false en cas de collision.
+ *
+ * Mêmes règles que la partie : progresser() puis, si une pomme est
+ * mangée, croissance et ajouterPomme() ; les pavés ne sont pas
+ * renouvelés, la simulation étant trop courte pour que cela compte.
+ */
+static bool jouerSimulation(RechercheMCTS *r, char touche) {
+    Partie *p = &r->simulation;
+    bool collision, pommeMangee;
+    p->direction = touche;
+    progresser(p, &collision, &pommeMangee);
+    r->profondeur++;
+    if (collision) return false;
+    if (pommeMangee) {
+        if (r->premierePomme < 0) r->premierePomme = r->profondeur;
+        p->tailleSerpent++;
+        if (!ajouterPomme(p)) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Distance approchée d'une case à la pomme de la partie simulée.
+ * @param r Recherche du thread.
+ * @param c Case évaluée.
+ *
+ * Tant que la pomme de la racine n'est pas mangée, la carte
+ * distancePomme, calculée avant la recherche et seulement lue
+ * par les threads, tient compte des murs et des portails ;
+ * ensuite on se contente de la distance de Manhattan.
+ */
+static int distanceSimulation(const RechercheMCTS *r, Case c) {
+    if (r->premierePomme < 0) {
+        return distancePomme[c] == INACCESSIBLE ? NBCASES : distancePomme[c];
+    }
+    Case pomme = r->simulation.posPomme;
+    return abs((int)CASEX(c) - (int)CASEX(pomme)) + abs((int)CASEY(c) - (int)CASEY(pomme));
+}
+
+/**
+ * @brief Termine une partie simulée au hasard, en préférant
+ * les déplacements qui rapprochent de la pomme.
+ * @param r Recherche du thread.
+ * @return false si le serpent est mort.
+ */
+static bool terminerSimulation(RechercheMCTS *r) {
+    Partie *p = &r->simulation;
+    char touches[4] = {DROITE, GAUCHE, HAUT, BAS};
+
+    while (r->profondeur < PROFONDEURSIMULATION) {
+        char possibles[4];
+        int nb = 0, meilleur = -1, distMin = 0;
+        Case tete = SEGMENT(p, 0);
+        for (int d = 0; d < 4; d++) {
+            if (!directionValide(touches[d], p->direction)) continue;
+            Case v = redirection[tete + DELTA[(unsigned char)touches[d]]];
+            if (!caseSure(p, v)) continue;
+            int dist = distanceSimulation(r, v);
+            if (meilleur < 0 || dist < distMin) {
+                meilleur = nb;
+                distMin = dist;
+            }
+            possibles[nb++] = touches[d];
+        }
+        if (nb == 0) return false;
+        /** trois fois sur quatre, le coup qui rapproche de la pomme */
+        uint32_t a = aleatoireMCTS(&r->graine);
+        char touche = (a & 3) ? possibles[meilleur] : possibles[(a >> 2) % nb];
+        if (!jouerSimulation(r, touche)) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Valeur d'une simulation, entre 0 (mort) et 1.
+ * @param r Recherche du thread, à la fin de la simulation.
+ * @param vivant Indique si le serpent a survécu.
+ *
+ * Survivre vaut au moins 0.3 ; une pomme vaut 1 tout de suite,
+ * puis de moins en moins, pour ne pas la remettre à plus tard.
+ * Sans pomme, le rapprochement de la pomme départage les simulations.
+ */
+static double recompense(const RechercheMCTS *r, bool vivant) {
+    if (!vivant) return 0.0;
+    if (r->premierePomme >= 0) {
+        return 0.5 + 0.5 * pow(DEPRECIATIONMCTS, r->premierePomme - 1);
+    }
+    double gain = mcts.distanceRacine - distanceSimulation(r, SEGMENT(&r->simulation, 0));
+    gain = (gain + PROFONDEURSIMULATION) / (2.0 * PROFONDEURSIMULATION);
+    return 0.3 + 0.2 * (gain < 0 ? 0 : gain > 1 ? 1 : gain);
+}
+
+/**
+ * @brief Une itération de la recherche : descente dans l'arbre
+ * (UCB1), ajout d'un noeud, simulation puis remontée du résultat.
+ * @param r Recherche du thread.
+ */
+static void itererMCTS(RechercheMCTS *r) {
+    char touches[4] = {DROITE, GAUCHE, HAUT, BAS};
+    int chemin[PROFONDEURSIMULATION + 1];
+    int longueur = 0, n = 0;
+    bool vivant = true;
+    Partie *p = &r->simulation;
+
+    copierPartie(p, &mcts.racine);
+    p->graine = ((uint64_t)aleatoireMCTS(&r->graine) << 32) | 1;
+    r->profondeur = 0;
+    r->premierePomme = -1;
+    chemin[longueur++] = 0;
+
+    while (vivant && r->profondeur < PROFONDEURSIMULATION) {
+        Noeud *noeud = &r->noeuds[n];
+        int choix = -1, nouveau = -1;
+        double meilleur = -1.0;
+        for (int d = 0; d < 4; d++) {
+            if (!directionValide(touches[d], p->direction)) continue;
+            int e = noeud->enfants[d];
+            if (e < 0) {
+                nouveau = d;
+                break;
+            }
+            double ucb = r->noeuds[e].gains / r->noeuds[e].visites +
+                EXPLORATIONMCTS * sqrt(log((double)noeud->visites) / r->noeuds[e].visites);
+            if (ucb > meilleur) {
+                meilleur = ucb;
+                choix = d;
+            }
+        }
+        if (nouveau >= 0 && r->nbNoeuds < MAXNOEUDSMCTS) {
+            /** nouveau noeud, puis simulation jusqu'au bout */
+            int e = r->nbNoeuds++;
+            r->noeuds[e] = (Noeud){{-1, -1, -1, -1}, 0, 0.0};
+            noeud->enfants[nouveau] = e;
+            chemin[longueur++] = e;
+            vivant = jouerSimulation(r, touches[nouveau]) && terminerSimulation(r);
+            break;
+        }
+        if (choix < 0) {
+            /** arbre plein : simulation depuis ce noeud */
+            vivant = terminerSimulation(r);
+            break;
+        }
+        n = noeud->enfants[choix];
+        chemin[longueur++] = n;
+        vivant = jouerSimulation(r, touches[choix]);
+    }
+
+    double valeur = recompense(r, vivant);
+    for (int k = 0; k < longueur; k++) {
+        r->noeuds[chemin[k]].visites++;
+        r->noeuds[chemin[k]].gains += valeur;
+    }
+    r->simulations++;
+}
+
+/**
+ * @brief Boucle d'un thread de recherche : attend une décision,
+ * cherche jusqu'à l'échéance, puis signale sa fin.
+ * @param arg Recherche du thread.
+ */
+static void *threadMCTS(void *arg) {
+    RechercheMCTS *r = arg;
+    unsigned long vue = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&mcts.verrou);
+        while (!mcts.arret && mcts.generation == vue) {
+            pthread_cond_wait(&mcts.debut, &mcts.verrou);
+        }
+        if (mcts.arret) {
+            pthread_mutex_unlock(&mcts.verrou);
+            return NULL;
+        }
+        vue = mcts.generation;
+        pthread_mutex_unlock(&mcts.verrou);
+
+        r->nbNoeuds = 1;
+        r->noeuds[0] = (Noeud){{-1, -1, -1, -1}, 0, 0.0};
+        r->simulations = 0;
+        struct timespec t;
+        do {
+            /** l'horloge n'est lue que toutes les 16 simulations */
+            for (int k = 0; k < 16; k++) itererMCTS(r);
+            clock_gettime(CLOCK_MONOTONIC, &t);
+        } while (t.tv_sec < mcts.echeance.tv_sec ||
+                 (t.tv_sec == mcts.echeance.tv_sec && t.tv_nsec < mcts.echeance.tv_nsec));
+
+        pthread_mutex_lock(&mcts.verrou);
+        if (--mcts.enCours == 0) pthread_cond_signal(&mcts.fin);
+        pthread_mutex_unlock(&mcts.verrou);
+    }
+}
+
+/**
+ * @brief Démarre les threads de recherche ; leurs arbres
+ * sont alloués ici une fois pour toute la partie.
+ * @param nbThreads Nombre de threads souhaité.
+ */
+void initMCTS(int nbThreads) {
+    if (nbThreads < 1) nbThreads = 1;
+    if (nbThreads > MAXTHREADSMCTS) nbThreads = MAXTHREADSMCTS;
+    mcts.nbThreads = nbThreads;
+    mcts.recherches = calloc(nbThreads, sizeof(RechercheMCTS));
+    pthread_mutex_init(&mcts.verrou, NULL);
+    pthread_cond_init(&mcts.debut, NULL);
+    pthread_cond_init(&mcts.fin, NULL);
+    for (int i = 0; i < nbThreads; i++) {
+        RechercheMCTS *r = &mcts.recherches[i];
+        r->noeuds = malloc(MAXNOEUDSMCTS * sizeof(Noeud));
+        r->graine = 0x9E3779B97F4A7C15ULL * (i + 1);
+        pthread_create(&r->thread, NULL, threadMCTS, r);
+    }
+}
+
+/**
+ * @brief Arrête les threads de recherche et libère leurs arbres.
+ */
+void arreterMCTS() {
+    pthread_mutex_lock(&mcts.verrou);
+    mcts.arret = true;
+    pthread_cond_broadcast(&mcts.debut);
+    pthread_mutex_unlock(&mcts.verrou);
+    for (int i = 0; i < mcts.nbThreads; i++) {
+        pthread_join(mcts.recherches[i].thread, NULL);
+        free(mcts.recherches[i].noeuds);
+    }
+    free(mcts.recherches);
+}
+
+/**
+ * @brief Choisit la touche à jouer par recherche Monte-Carlo.
+ * @param p Partie en cours.
+ * @return Touche la plus explorée par l'ensemble des threads.
+ *
+ * Chaque thread construit son propre arbre depuis une copie
+ * de la position ; leurs visites à la racine sont additionnées.
+ */
+char decisionMCTS(Partie *p) {
+    char touches[4] = {DROITE, GAUCHE, HAUT, BAS};
+    struct timespec debut, fin;
+    int budget = mcts.budget > 0 ? mcts.budget : p->temporisation;
+
+    clock_gettime(CLOCK_MONOTONIC, &debut);
+    mcts.distanceRacine = distanceALaPomme(p, SEGMENT(p, 0));
+    copierPartie(&mcts.racine, p);
+    mcts.echeance = debut;
+    mcts.echeance.tv_nsec += (long)budget * 1000;
+    mcts.echeance.tv_sec += mcts.echeance.tv_nsec / 1000000000;
+    mcts.echeance.tv_nsec %= 1000000000;
+
+    pthread_mutex_lock(&mcts.verrou);
+    mcts.generation++;
+    mcts.enCours = mcts.nbThreads;
+    pthread_cond_broadcast(&mcts.debut);
+    while (mcts.enCours > 0) {
+        pthread_cond_wait(&mcts.fin, &mcts.verrou);
+    }
+    pthread_mutex_unlock(&mcts.verrou);
+
+    long visites[4] = {0, 0, 0, 0};
+    for (int i = 0; i < mcts.nbThreads; i++) {
+        RechercheMCTS *r = &mcts.recherches[i];
+        for (int d = 0; d < 4; d++) {
+            if (r->noeuds[0].enfants[d] >= 0) {
+                visites[d] += r->noeuds[r->noeuds[0].enfants[d]].visites;
+            }
+        }
+        mcts.totalSimulations += r->simulations;
+    }
+    char touche = p->direction;
+    long meilleur = -1;
+    for (int d = 0; d < 4; d++) {
+        if (directionValide(touches[d], p->direction) && visites[d] > meilleur) {
+            meilleur = visites[d];
+            touche = touches[d];
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &fin);
+    mcts.nbDecisions++;
+    mcts.dureeDecision = (fin.tv_sec - debut.tv_sec) * 1000000L + (fin.tv_nsec - debut.tv_nsec) / 1000;
+    mcts.dureeTotale += (fin.tv_sec - debut.tv_sec) + (fin.tv_nsec - debut.tv_nsec) / 1e9;
+    return touche;
+}
+
+/*****************************************************
+*          ENVIRONNEMENT D'APPRENTISSAGE             *
+*****************************************************/
+
+/**
+ * @brief Offset d'une case dans un plan d'observation.
+ */
+static inline int caseObservation(Plan plan, Case c) {
+    return plan * TAILLEPLAN + CASEY(c) * LARGEURMAX + CASEX(c);
+}
+
+/**
+ * @brief Encode une suite de cases d'une ligne du plateau dans les plans.
+ * @param ligne Cases du plateau.
+ * @param issues Cases correspondantes du plan des portails.
+ * @param n Nombre de cases.
+ * @param plans Première case dans le premier plan.
+ * @param pas Distance entre deux plans.
+ *
+ * Comparaisons de 32 (AVX2) ou 16 (SSE2) cases à la fois, masquées
+ * à 1 ; les dernières cases sont traitées une à une.
+ */
+static void encoderLigne(const char *ligne, const uint8_t *issues, int n, uint8_t *plans, int pas) {
+    int j = 0;
+#if defined(__AVX2__)
+    const __m256i un = _mm256_set1_epi8(1);
+    for (; j + 32 <= n; j += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(ligne + j));
+        __m256i tete = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(TETE));
+        __m256i corps = _mm256_or_si256(tete, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(CORPS)));
+        _mm256_storeu_si256((__m256i *)(plans + PLAN_OBSTACLE * pas + j),
+            _mm256_and_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(CARBORDURE)), un));
+        _mm256_storeu_si256((__m256i *)(plans + PLAN_CORPS * pas + j), _mm256_and_si256(corps, un));
+        _mm256_storeu_si256((__m256i *)(plans + PLAN_TETE * pas + j), _mm256_and_si256(tete, un));
+        _mm256_storeu_si256((__m256i *)(plans + PLAN_POMME * pas + j),
+            _mm256_and_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(POMME)), un));
+        _mm256_storeu_si256((__m256i *)(plans + PLAN_ISSUE * pas + j),
+            _mm256_loadu_si256((const __m256i *)(issues + j)));
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i un16 = _mm_set1_epi8(1);
+    for (; j + 16 <= n; j += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(ligne + j));
+        __m128i tete = _mm_cmpeq_epi8(v, _mm_set1_epi8(TETE));
+        __m128i corps = _mm_or_si128(tete, _mm_cmpeq_epi8(v, _mm_set1_epi8(CORPS)));
+        _mm_storeu_si128((__m128i *)(plans + PLAN_OBSTACLE * pas + j),
+            _mm_and_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(CARBORDURE)), un16));
+        _mm_storeu_si128((__m128i *)(plans + PLAN_CORPS * pas + j), _mm_and_si128(corps, un16));
+        _mm_storeu_si128((__m128i *)(plans + PLAN_TETE * pas + j), _mm_and_si128(tete, un16));
+        _mm_storeu_si128((__m128i *)(plans + PLAN_POMME * pas + j),
+            _mm_and_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(POMME)), un16));
+        _mm_storeu_si128((__m128i *)(plans + PLAN_ISSUE * pas + j),
+            _mm_loadu_si128((const __m128i *)(issues + j)));
+    }
+#endif
+    for (; j < n; j++) {
+        char v = ligne[j];
+        plans[PLAN_OBSTACLE * pas + j] = v == CARBORDURE;
+        plans[PLAN_CORPS * pas + j] = v == CORPS || v == TETE;
+        plans[PLAN_TETE * pas + j] = v == TETE;
+        plans[PLAN_POMME * pas + j] = v == POMME;
+        plans[PLAN_ISSUE * pas + j] = issues[j];
+    }
+}
+
+/**
+ * @brief Écrit l'observation complète d'une partie.
+ * @param p Partie observée.
+ * @param observation Plans de la partie (TAILLEOBSERVATION octets).
+ */
+void encoderPlateau(Partie *p, uint8_t observation[TAILLEOBSERVATION]) {
+    for (int i = 0; i < HAUTEURMAX; i++) {
+        encoderLigne(p->plateau[i], planIssues + i * LARGEURMAX, LARGEURMAX,
+                     observation + i * LARGEURMAX, TAILLEPLAN);
+    }
+}
+
+/**
+ * @brief Écrit les plans d'une fenêtre COTEFENETRE x COTEFENETRE
+ * centrée sur la tête ; ce qui sort du plateau compte comme obstacle.
+ * @param p Partie observée.
+ * @param observation Plans de la fenêtre (NBPLANS * TAILLEPLANFENETRE octets).
+ */
+void encoderFenetre(Partie *p, uint8_t observation[NBPLANS * TAILLEPLANFENETRE]) {
+    int x0 = CASEX(SEGMENT(p, 0)) - RAYONFENETRE, y0 = CASEY(SEGMENT(p, 0)) - RAYONFENETRE;
+    /** colonnes de la fenêtre qui tombent sur le plateau */
+    int debut = x0 < 0 ? -x0 : 0;
+    int fin = x0 + COTEFENETRE > LARGEURMAX ? LARGEURMAX - x0 : COTEFENETRE;
+
+    memset(observation, 0, NBPLANS * TAILLEPLANFENETRE);
+    for (int i = 0; i < COTEFENETRE; i++) {
+        uint8_t *plans = observation + i * COTEFENETRE;
+        int y = y0 + i;
+        if (y < 0 || y >= HAUTEURMAX) {
+            memset(plans + PLAN_OBSTACLE * TAILLEPLANFENETRE, 1, COTEFENETRE);
+            continue;
+        }
+        /** une ligne de la fenêtre tient dans un seul bloc de 16 cases,
+         * encodé à part puis recopié (le plateau a une ligne de plus
+         * que HAUTEURMAX, la lecture reste dans le tableau) */
+        uint8_t ligne[NBPLANS * 16];
+        encoderLigne(p->plateau[y] + x0 + debut, planIssues + y * LARGEURMAX + x0 + debut,
+                     16, ligne, 16);
+        for (int k = 0; k < NBPLANS; k++) {
+            memcpy(plans + k * TAILLEPLANFENETRE + debut, ligne + k * 16, fin - debut);
+        }
+        memset(plans + PLAN_OBSTACLE * TAILLEPLANFENETRE, 1, debut);
+        memset(plans + PLAN_OBSTACLE * TAILLEPLANFENETRE + fin, 1, COTEFENETRE - fin);
+    }
+}
+
+/**
+ * @brief Commence une nouvelle partie dans un environnement.
+ * @param e Environnement.
+ * @param k Numéro de la partie.
+ */
+static void recommencerPartie(Environnement *e, int k) {
+    e->graine = e->graine * 6364136223846793005ULL + 1442695040888963407ULL;
+    initPartie(&e->parties[k], e->graine);
+    e->pasSansPomme[k] = 0;
+    encoderPlateau(&e->parties[k], e->observations + (size_t)k * TAILLEOBSERVATION);
+}
+
+/**
+ * @brief Prépare nb parties (reset) et leurs premières observations.
+ * @param e Environnement (les parties ne sont allouées qu'une fois
+ * tant que nb ne change pas).
+ * @param nb Nombre de parties.
+ * @param graine Graine des parties successives.
+ * @param observations Tampon de l'appelant, nb * TAILLEOBSERVATION octets.
+ * @return false si la mémoire manque.
+ */
+bool initEnvironnement(Environnement *e, int nb, uint64_t graine, uint8_t *observations) {
+    if (e->parties == NULL || e->nb != nb) {
+        libererEnvironnement(e);
+        e->parties = malloc((size_t)nb * sizeof(Partie));
+        e->pasSansPomme = malloc((size_t)nb * sizeof(int));
+        if (e->parties == NULL || e->pasSansPomme == NULL) {
+            libererEnvironnement(e);
+            return false;
+        }
+        e->nb = nb;
+    }
+    e->observations = observations;
+    e->graine = graine;
+    for (int k = 0; k < nb; k++) {
+        recommencerPartie(e, k);
+    }
+    return true;
+}
+
+/**
+ * @brief Joue un déplacement dans chaque partie (step).
+ * @param e Environnement.
+ * @param actions Par partie, 0 à 3 pour DROITE, GAUCHE, HAUT, BAS
+ * (un demi-tour est ignoré, comme au clavier).
+ * @param recompenses Par partie : 1 pour une pomme, -1 pour une collision.
+ * @param finies Par partie : vrai si elle vient de se terminer ;
+ * elle est alors recommencée, et son observation est la nouvelle.
+ *
+ * Seules les cases qui changent sont réécrites dans l'observation :
+ * tête, queue et pomme ; le plateau n'est réencodé en entier
+ * qu'après une pomme, les pavés ayant bougé.
+ */
+void avancerEnvironnement(Environnement *e, const int actions[], float recompenses[], bool finies[]) {
+    const char touches[4] = {DROITE, GAUCHE, HAUT, BAS};
+
+    for (int k = 0; k < e->nb; k++) {
+        Partie *p = &e->parties[k];
+        uint8_t *obs = e->observations + (size_t)k * TAILLEOBSERVATION;
+        bool collision, pommeMangee;
+        char touche = touches[actions[k] & 3];
+
+        if (directionValide(touche, p->direction)) {
+            p->direction = touche;
+        }
+        Case ancienneTete = SEGMENT(p, 0), queue = SEGMENT(p, p->tailleSerpent - 1);
+        progresser(p, &collision, &pommeMangee);
+        recompenses[k] = 0.0f;
+        finies[k] = false;
+
+        if (collision) {
+            recompenses[k] = -1.0f;
+            finies[k] = true;
+        } else if (pommeMangee) {
+            recompenses[k] = 1.0f;
+            e->pasSansPomme[k] = 0;
+            finies[k] = !mangerPomme(p) || p->pommesMangees >= nbrePommesFinJeu;
+            if (!finies[k]) encoderPlateau(p, obs);
+        } else {
+            obs[caseObservation(PLAN_CORPS, queue)] = 0;
+            obs[caseObservation(PLAN_TETE, ancienneTete)] = 0;
+            obs[caseObservation(PLAN_CORPS, SEGMENT(p, 0))] = 1;
+            obs[caseObservation(PLAN_TETE, SEGMENT(p, 0))] = 1;
+            /** une partie qui tourne en rond est coupée */
+            finies[k] = ++e->pasSansPomme[k] > NBCASES;
+        }
+        if (finies[k]) recommencerPartie(e, k);
+    }
+}
+
+/**
+ * @brief Libère les parties d'un environnement.
+ * @param e Environnement.
+ */
+void libererEnvironnement(Environnement *e) {
+    free(e->parties);
+    free(e->pasSansPomme);
+    e->parties = NULL;
+    e->pasSansPomme = NULL;
+    e->nb = 0;
+}
+
+/**
+ * @brief Mesure le débit de l'environnement, actions tirées au hasard.
+ * @param nb Nombre de parties jouées en même temps.
+ */
+void mesurerEnvironnement(int nb) {
+    Environnement e = {0};
+    if (nb < 1) nb = 1;
+    uint8_t *observations = malloc((size_t)nb * TAILLEOBSERVATION);
+    int *actions = malloc(nb * sizeof(int));
+    float *recompenses = malloc(nb * sizeof(float));
+    bool *finies = malloc(nb * sizeof(bool));
+    if (observations == NULL || actions == NULL || recompenses == NULL || finies == NULL ||
+        !initEnvironnement(&e, nb, 1, observations)) {
+        fprintf(stderr, "Mémoire insuffisante pour %d parties.\n", nb);
+        exit(EXIT_FAILURE);
+    }
+
+    struct timespec debut, fin;
+    long pas = 0, parties = 0, pommes = 0;
+    uint64_t x = 0x9E3779B97F4A7C15ULL;
+    double duree;
+    clock_gettime(CLOCK_MONOTONIC, &debut);
+    do {
+        for (int n = 0; n < 1000; n++) {
+            for (int k = 0; k < nb; k++) {
+                x ^= x << 13;
+                x ^= x >> 7;
+                x ^= x << 17;
+                /** le plus souvent tout droit, pour des parties moins courtes */
+                actions[k] = (x >> 60) < 12 ? -1 : (int)(x >> 62);
+                if (actions[k] < 0) {
+                    char d = e.parties[k].direction;
+                    actions[k] = d == DROITE ? 0 : d == GAUCHE ? 1 : d == HAUT ? 2 : 3;
+                }
+            }
+            avancerEnvironnement(&e, actions, recompenses, finies);
+            for (int k = 0; k < nb; k++) {
+                parties += finies[k];
+                pommes += recompenses[k] > 0;
+            }
+            pas += nb;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &fin);
+        duree = (fin.tv_sec - debut.tv_sec) + (fin.tv_nsec - debut.tv_nsec) / 1e9;
+    } while (duree < 2.0);
+
+    printf("Environnement : %d parties, %.0f pas/s, %ld parties terminées, %ld pommes.\n",
+           nb, pas / duree, parties, pommes);
+
+    /** coût des encodeurs seuls */
+    static uint8_t fenetre[NBPLANS * TAILLEPLANFENETRE];
+    const int NBENCODAGES = 100000;
+    clock_gettime(CLOCK_MONOTONIC, &debut);
+    for (int n = 0; n < NBENCODAGES; n++) {
+        encoderPlateau(&e.parties[n % nb], observations + (size_t)(n % nb) * TAILLEOBSERVATION);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &fin);
+    duree = (fin.tv_sec - debut.tv_sec) + (fin.tv_nsec - debut.tv_nsec) / 1e9;
+    printf("Plateau complet : %.0f ns par encodage", duree / NBENCODAGES * 1e9);
+    clock_gettime(CLOCK_MONOTONIC, &debut);
+    for (int n = 0; n < NBENCODAGES; n++) {
+        encoderFenetre(&e.parties[n % nb], fenetre);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &fin);
+    duree = (fin.tv_sec - debut.tv_sec) + (fin.tv_nsec - debut.tv_nsec) / 1e9;
+    printf(", fenêtre %dx%d : %.0f ns.\n", COTEFENETRE, COTEFENETRE, duree / NBENCODAGES * 1e9);
+    libererEnvironnement(&e);
+    free(observations);
+    free(actions);
+    free(recompenses);
+    free(finies);
+}
+
+/*****************************************************
+*               FLUX DE DIFFUSION                    *
+*****************************************************/
+
+/**
+ * @brief Écrit un entier en varint : 7 bits par octet, poids faibles
+ * d'abord, bit 7 à 1 tant qu'il reste des octets.
+ * @param o Position d'écriture.
+ * @param v Entier.
+ * @return Position suivant l'entier écrit.
+ */
+static uint8_t *ecrireVarint(uint8_t *o, uint32_t v) {
+    while (v >= 0x80) {
+        *o++ = (v & 0x7F) | 0x80;
+        v >>= 7;
+    }
+    *o++ = v;
+    return o;
+}
+
+/**
+ * @brief Lit un entier codé par ecrireVarint().
+ * @param i Position de lecture, avancée après l'entier.
+ * @param fin Fin des octets disponibles.
+ * @param v Entier lu.
+ * @param max Borne (exclue) des valeurs acceptées.
+ * @return 1 si l'entier est lu, 0 s'il est incomplet,
+ * -1 s'il est trop long ou hors bornes.
+ */
+static int lireVarint(const uint8_t **i, const uint8_t *fin, uint32_t *v, uint32_t max) {
+    *v = 0;
+    for (int decalage = 0; decalage < 35; decalage += 7) {
+        if (*i == fin) return 0;
+        uint8_t octet = *(*i)++;
+        *v |= (uint32_t)(octet & 0x7F) << decalage;
+        if (!(octet & 0x80)) return *v < max ? 1 : -1;
+    }
+    return -1;
+}
+
+/**
+ * @brief Code sur 2 bits d'une direction du serpent.
+ * @param direction Touche de direction.
+ */
+static int codeDirection(char direction) {
+    for (int d = 0; d < 4; d++) {
+        if (DIRECTIONSFLUX[d] == direction) return d;
+    }
+    return 0;
+}
+
+/**
+ * @brief Écrit les pavés par plages : longueurs alternées de cases
+ * intérieures sans puis avec pavé, dans l'ordre des lignes, jusqu'à
+ * couvrir tout l'intérieur du plateau.
+ * @param o Position d'écriture.
+ * @param p Partie dont les pavés sont écrits.
+ * @return Position suivant les plages.
+ *
+ * Les pavés peuvent se chevaucher : on transmet leurs cases et non
+ * leurs coins, une cinquantaine d'octets pour NBREPAVE pavés.
+ */
+static uint8_t *ecrirePaves(uint8_t *o, const Partie *p) {
+    bool pave = false;
+    uint32_t plage = 0;
+    for (int i = 1; i < HAUTEURMAX - 1; i++) {
+        for (int j = 1; j < LARGEURMAX - 1; j++) {
+            if ((p->plateau[i][j] == CARBORDURE) != pave) {
+                o = ecrireVarint(o, plage);
+                pave = !pave;
+                plage = 0;
+            }
+            plage++;
+        }
+    }
+    return ecrireVarint(o, plage);
+}
+
+/**
+ * @brief Lit des pavés écrits par ecrirePaves() et, si demandé,
+ * remplace ceux de la partie.
+ * @param i Position de lecture, avancée après les plages.
+ * @param fin Fin des octets disponibles.
+ * @param p Partie à modifier.
+ * @param appliquer Faux pour seulement vérifier le message.
+ * @return 1 si les plages sont lues, 0 si elles sont incomplètes,
+ * -1 si elles sont incohérentes.
+ */
+static int lirePaves(const uint8_t **i, const uint8_t *fin, Partie *p, bool appliquer) {
+    const uint32_t interieur = (HAUTEURMAX - 2) * (LARGEURMAX - 2);
+    uint32_t vues = 0;
+    bool pave = false;
+    if (appliquer) {
+        for (int y = 1; y < HAUTEURMAX - 1; y++) {
+            for (int x = 1; x < LARGEURMAX - 1; x++) {
+                if (p->plateau[y][x] == CARBORDURE) p->plateau[y][x] = VIDE;
+            }
+        }
+    }
+    while (vues < interieur) {
+        uint32_t plage;
+        int lu = lireVarint(i, fin, &plage, interieur - vues + 1);
+        if (lu <= 0) return lu;
+        for (uint32_t k = vues; appliquer && pave && k < vues + plage; k++) {
+            p->plateau[k / (LARGEURMAX - 2) + 1][k % (LARGEURMAX - 2) + 1] = CARBORDURE;
+        }
+        vues += plage;
+        pave = !pave;
+    }
+    return 1;
+}
+
+/**
+ * @brief Prépare un encodeur : sa première sortie sera une image clé.
+ * @param f Encodeur.
+ * @param intervalle Ticks entre deux images clés.
+ */
+void initFlux(Flux *f, int intervalle) {
+    f->intervalle = intervalle > 0 ? intervalle : INTERVALLEIMAGESCLES;
+    f->tick = 0;
+    f->aJour = false;
+}
+
+/**
+ * @brief Encode l'état complet d'une partie dans f->message.
+ * @param f Encodeur.
+ * @param p Partie.
+ * @return Nombre d'octets du message.
+ *
+ * Image clé : IMAGECLE, puis en varint le tick, la largeur et la
+ * hauteur du plateau, les portails (nombre puis entrée et sortie),
+ * la pomme, les pommes mangées, la direction, la taille et les cases
+ * du serpent depuis la tête, et enfin les pavés par plages.
+ * Les cases sont des indices linéaires (LARGEURMAX + 1 par ligne).
+ */
+int encoderImageCle(Flux *f, const Partie *p) {
+    uint8_t *o = f->message;
+    *o++ = IMAGECLE;
+    o = ecrireVarint(o, f->tick);
+    o = ecrireVarint(o, LARGEURMAX);
+    o = ecrireVarint(o, HAUTEURMAX);
+    o = ecrireVarint(o, nbPortails);
+    for (int k = 0; k < nbPortails; k++) {
+        o = ecrireVarint(o, entreesPortails[k]);
+        o = ecrireVarint(o, sortiesPortails[k]);
+    }
+    o = ecrireVarint(o, p->posPomme);
+    o = ecrireVarint(o, p->pommesMangees);
+    o = ecrireVarint(o, codeDirection(p->direction));
+    o = ecrireVarint(o, p->tailleSerpent);
+    for (int i = 0; i < p->tailleSerpent; i++) {
+        o = ecrireVarint(o, SEGMENT(p, i));
+    }
+    o = ecrirePaves(o, p);
+
+    f->aJour = true;
+    f->tete = SEGMENT(p, 0);
+    f->pomme = p->posPomme;
+    f->taille = p->tailleSerpent;
+    f->pommes = p->pommesMangees;
+    return o - f->message;
+}
+
+/**
+ * @brief Encode dans f->message ce qui a changé depuis le tick précédent.
+ * @param f Encodeur.
+ * @param p Partie, après progresser() et la branche de la pomme.
+ * @return Nombre d'octets du message.
+ *
+ * Delta : un octet DELTAFLUX, avec la direction de la nouvelle tête,
+ * DELTAQUEUE si la queue a avancé, DELTAPOMME suivi de la case de la
+ * nouvelle pomme, DELTAPAVES suivi des nouveaux pavés. Un déplacement
+ * sans pomme tient donc en un octet. Tout changement qui n'est pas
+ * un pas du serpent (retour en arrière, partie rechargée) donne
+ * une image clé, comme l'intervalle.
+ */
+int encoderTick(Flux *f, const Partie *p) {
+    f->tick++;
+    int d = codeDirection(p->direction);
+    int croissance = p->tailleSerpent - f->taille;
+    bool pas = p->tailleSerpent > 1 && SEGMENT(p, 1) == f->tete &&
+        redirection[f->tete + DELTA[(unsigned char)DIRECTIONSFLUX[d]]] == SEGMENT(p, 0);
+    if (!f->aJour || f->tick % f->intervalle == 0 || !pas || croissance < 0 || croissance > 1) {
+        return encoderImageCle(f, p);
+    }
+
+    uint8_t *o = f->message;
+    uint8_t *entete = o++;
+    *entete = DELTAFLUX | d;
+    if (croissance == 0) *entete |= DELTAQUEUE;
+    if (p->pommesMangees != f->pommes) {
+        *entete |= DELTAPAVES;
+        o = ecrirePaves(o, p);
+    }
+    if (p->posPomme != f->pomme) {
+        *entete |= DELTAPOMME;
+        o = ecrireVarint(o, p->posPomme);
+    }
+
+    f->tete = SEGMENT(p, 0);
+    f->pomme = p->posPomme;
+    f->taille = p->tailleSerpent;
+    f->pommes = p->pommesMangees;
+    return o - f->message;
+}
+
+/**
+ * @brief Indique si un indice lu dans un flux désigne une case
+ * intérieure du plateau (ni bordure, ni colonne de fin de ligne).
+ * @param c Indice linéaire, pas encore vérifié.
+ */
+static bool caseInterieure(uint32_t c) {
+    return c < NBCASES && CASEX(c) >= 1 && CASEX(c) < LARGEURMAX - 1 &&
+        CASEY(c) >= 1 && CASEY(c) < HAUTEURMAX - 1;
+}
+
+/**
+ * @brief Lit une image clé et, si demandé, l'applique.
+ * @return 1 si le message est lu, 0 s'il est incomplet, -1 s'il est invalide.
+ *
+ * Les entrées des portails et la tête doivent être sur le plateau
+ * (la tête est dans une bordure au tick de la collision), les
+ * sorties, la pomme et le reste du serpent à l'intérieur : le flux
+ * peut venir d'ailleurs, et les deltas lisent redirection[] autour
+ * de la tête.
+ */
+static int lireImageCle(const uint8_t **i, const uint8_t *fin, Partie *p, bool appliquer) {
+    uint32_t tick, largeur, hauteur, portails, pomme, pommes, direction, taille;
+    int lu;
+    if ((lu = lireVarint(i, fin, &tick, UINT32_MAX)) <= 0 ||
+        (lu = lireVarint(i, fin, &largeur, LARGEURMAX + 1)) <= 0 ||
+        (lu = lireVarint(i, fin, &hauteur, HAUTEURMAX + 1)) <= 0 ||
+        (lu = lireVarint(i, fin, &portails, MAXPORTAILS + 1)) <= 0) return lu;
+    /** le plateau doit être celui pour lequel ce programme est compilé */
+    if (largeur != LARGEURMAX || hauteur != HAUTEURMAX) return -1;
+    if (appliquer) {
+        for (int c = 0; c < NBCASES; c++) {
+            redirection[c] = c;
+        }
+        memset(planIssues, 0, sizeof(planIssues));
+        nbPortails = 0;
+    }
+    for (uint32_t k = 0; k < portails; k++) {
+        uint32_t entree, sortie;
+        if ((lu = lireVarint(i, fin, &entree, NBCASES)) <= 0 ||
+            (lu = lireVarint(i, fin, &sortie, NBCASES)) <= 0) return lu;
+        if (CASEX(entree) >= LARGEURMAX || CASEY(entree) >= HAUTEURMAX ||
+            !caseInterieure(sortie)) return -1;
+        if (appliquer) ajouterPortail(CASEX(entree), CASEY(entree), CASEX(sortie), CASEY(sortie));
+    }
+    if ((lu = lireVarint(i, fin, &pomme, NBCASES)) <= 0 ||
+        (lu = lireVarint(i, fin, &pommes, INT32_MAX)) <= 0 ||
+        (lu = lireVarint(i, fin, &direction, 4)) <= 0 ||
+        (lu = lireVarint(i, fin, &taille, MAXTAILLESERPENT + 1)) <= 0) return lu;
+    if (taille < 1 || !caseInterieure(pomme)) return -1;
+    if (appliquer) {
+        initPlateau(p);
+        p->posPomme = pomme;
+        p->pommesMangees = pommes;
+        p->direction = DIRECTIONSFLUX[direction];
+        p->tailleSerpent = taille;
+        p->tete = 0;
+        p->generation = nouvelleGeneration();
+    }
+    for (uint32_t k = 0; k < taille; k++) {
+        uint32_t c;
+        if ((lu = lireVarint(i, fin, &c, NBCASES)) <= 0) return lu;
+        if (k == 0 ? CASEX(c) >= LARGEURMAX || CASEY(c) >= HAUTEURMAX : !caseInterieure(c)) return -1;
+        if (appliquer) p->corps[k] = c;
+    }
+    if ((lu = lirePaves(i, fin, p, appliquer)) <= 0) return lu;
+    if (appliquer) {
+        for (uint32_t k = 1; k < taille; k++) {
+            CASEPLATEAU(p, SEGMENT(p, k)) = CORPS;
+        }
+        CASEPLATEAU(p, SEGMENT(p, 0)) = TETE;
+        CASEPLATEAU(p, p->posPomme) = POMME;
+    }
+    return 1;
+}
+
+/**
+ * @brief Lit un delta et, si demandé, l'applique comme le ferait
+ * progresser() puis la branche de la pomme.
+ * @return 1 si le message est lu, 0 s'il est incomplet, -1 s'il est invalide
+ * (dont un pas depuis une tête qui n'est plus à l'intérieur).
+ */
+static int lireDelta(const uint8_t **i, const uint8_t *fin, Partie *p, bool appliquer) {
+    uint8_t entete = *(*i)++;
+    char direction = DIRECTIONSFLUX[entete & DELTADIRECTION];
+    int lu;
+    if (!caseInterieure(SEGMENT(p, 0))) return -1;
+    if (appliquer) {
+        Case ancienne = SEGMENT(p, 0);
+        Case tete = redirection[ancienne + DELTA[(unsigned char)direction]];
+        if (tete == p->posPomme) p->pommesMangees++;
+        if (entete & DELTAQUEUE) CASEPLATEAU(p, SEGMENT(p, p->tailleSerpent - 1)) = VIDE;
+        p->tete = p->tete == 0 ? MAXTAILLESERPENT - 1 : p->tete - 1;
+        p->corps[p->tete] = tete;
+        if (!(entete & DELTAQUEUE)) p->tailleSerpent++;
+        CASEPLATEAU(p, ancienne) = CORPS;
+        CASEPLATEAU(p, tete) = TETE;
+        p->direction = direction;
+    }
+    if ((entete & DELTAPAVES) && (lu = lirePaves(i, fin, p, appliquer)) <= 0) return lu;
+    if (entete & DELTAPOMME) {
+        uint32_t pomme;
+        if ((lu = lireVarint(i, fin, &pomme, NBCASES)) <= 0) return lu;
+        if (!caseInterieure(pomme)) return -1;
+        if (appliquer) {
+            /** pomme déplacée sans avoir été mangée (pilote hamiltonien) */
+            if (CASEPLATEAU(p, p->posPomme) == POMME) CASEPLATEAU(p, p->posPomme) = VIDE;
+            p->posPomme = pomme;
+            CASEPLATEAU(p, pomme) = POMME;
+            p->generation = nouvelleGeneration();
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Applique à une partie le premier message d'un flux.
+ * @param p Partie reconstruite (une image clé doit précéder les deltas).
+ * @param message Octets reçus.
+ * @param taille Nombre d'octets reçus.
+ * @return Octets consommés, 0 si le message est encore incomplet,
+ * -1 s'il est invalide.
+ *
+ * Le message est vérifié en entier avant d'être appliqué : une partie
+ * n'est jamais laissée à moitié modifiée. L'empreinte est recalculée.
+ */
+int decoderFlux(Partie *p, const uint8_t *message, int taille) {
+    const uint8_t *fin = message + taille;
+    if (taille < 1) return 0;
+    bool cle = message[0] == IMAGECLE;
+    if (!cle) {
+        /** un delta s'applique à une partie déjà reçue, qui peut grandir */
+        if ((message[0] & 0xE0) != DELTAFLUX || p->tailleSerpent < 1) return -1;
+        if (!(message[0] & DELTAQUEUE) && p->tailleSerpent == MAXTAILLESERPENT) return -1;
+    }
+    const uint8_t *i = message + cle;
+    int lu = cle ? lireImageCle(&i, fin, p, false) : lireDelta(&i, fin, p, false);
+    if (lu <= 0) return lu;
+    int lus = i - message;
+    i = message + cle;
+    if (cle) lireImageCle(&i, fin, p, true);
+    else lireDelta(&i, fin, p, true);
+    p->empreinte = recalculerEmpreinte(p);
+    return lus;
+}
+
+/**
+ * @brief Rejoue dans le terminal un flux écrit par --diffuser
+ * (fichier ou tube nommé, lu au fur et à mesure).
+ * @param fichier Chemin du flux.
+ */
+void relireFlux(const char *fichier) {
+    static uint8_t tampon[2 * TAILLEMAXFLUX];
+    Partie *p = &partie;
+    int fd = open(fichier, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Flux illisible : %s\n", fichier);
+        return;
+    }
+    int debut = 0, fin = 0;
+    ssize_t n;
+    /** la partie est vide : le flux doit commencer par une image clé */
+    p->tailleSerpent = 0;
+    while ((n = read(fd, tampon + fin, sizeof(tampon) - fin)) > 0) {
+        fin += n;
+        int lus;
+        while ((lus = decoderFlux(p, tampon + debut, fin - debut)) > 0) {
+            debut += lus;
+            dessinerPlateau(p);
+            usleep(DELAIRELECTURE);
+        }
+        if (lus < 0) {
+            fprintf(stderr, "Flux invalide : %s\n", fichier);
+            break;
+        }
+        memmove(tampon, tampon + debut, fin - debut);
+        fin -= debut;
+        debut = 0;
+    }
+    close(fd);
+}
+
+/*****************************************************
+*          SPECTATEURS EN MEMOIRE PARTAGEE           *
+*****************************************************/
+
+/**
+ * @brief Nom d'objet de mémoire partagée POSIX : commence par '/'.
+ */
+static void cheminTribune(const char *nom, char chemin[256]) {
+    snprintf(chemin, 256, "%s%s", nom[0] == '/' ? "" : "/", nom);
+}
+
+/**
+ * @brief Crée la tribune d'une partie.
+ * @param nom Nom de la mémoire partagée (/dev/shm/nom).
+ * @return La tribune, ou NULL en cas d'erreur.
+ *
+ * Une tribune laissée par une partie précédente n'est pas tronquée :
+ * ses spectateurs, qui la projettent encore, recevraient SIGBUS. Elle
+ * est retirée puis marquée remplacée, et ils rejoignent la nouvelle.
+ */
+Tribune *ouvrirTribune(const char *nom) {
+    char chemin[256];
+    cheminTribune(nom, chemin);
+    int fd = shm_open(chemin, O_RDWR, 0);
+    if (fd >= 0) {
+        shm_unlink(chemin);
+        struct stat etat;
+        if (fstat(fd, &etat) == 0 && etat.st_size == (off_t)sizeof(Tribune)) {
+            Tribune *ancienne = mmap(NULL, sizeof(Tribune), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (ancienne != MAP_FAILED) {
+                atomic_store_explicit(&ancienne->remplacee, true, memory_order_release);
+                munmap(ancienne, sizeof(Tribune));
+            }
+        }
+        close(fd);
+    }
+    fd = shm_open(chemin, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) return NULL;
+    if (ftruncate(fd, sizeof(Tribune)) < 0) {
+        close(fd);
+        shm_unlink(chemin);
+        return NULL;
+    }
+    Tribune *t = mmap(NULL, sizeof(Tribune), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (t == MAP_FAILED) return NULL;
+    t->largeur = LARGEURMAX;
+    t->hauteur = HAUTEURMAX;
+    t->nbImages = NBIMAGESTRIBUNE;
+    t->tailleImage = sizeof(ImageSpectateur);
+    atomic_thread_fence(memory_order_release);
+    memcpy(t->magie, MAGIETRIBUNE, sizeof(t->magie));
+    return t;
+}
+
+/**
+ * @brief Publie l'image d'un tick dans la tribune.
+ * @param t Tribune.
+ * @param p Partie.
+ * @param tick Numéro du tick.
+ * @param issue Issue de la partie (PARTIE_EN_COURS jusqu'à la dernière image).
+ *
+ * L'image n va dans la case n % NBIMAGESTRIBUNE, encadrée par sa
+ * séquence ; aucun spectateur n'est attendu ni même connu.
+ */
+void publierImage(Tribune *t, const Partie *p, uint32_t tick, IssuePartie issue) {
+    uint64_t n = atomic_load_explicit(&t->publiees, memory_order_relaxed);
+    CaseTribune *c = &t->cases[n % NBIMAGESTRIBUNE];
+    atomic_store_explicit(&c->sequence, 2 * n + 1, memory_order_relaxed);
+    /** la séquence impaire est visible avant toute écriture de l'image */
+    atomic_thread_fence(memory_order_release);
+    remplirImage(&c->image, p, tick, issue);
+    atomic_store_explicit(&c->sequence, 2 * n + 2, memory_order_release);
+    atomic_store_explicit(&t->publiees, n + 1, memory_order_release);
+}
+
+/**
+ * @brief Copie dans une image ce qu'un spectateur voit d'une partie.
+ * @param image Image à remplir.
+ * @param p Partie.
+ * @param tick Numéro du tick.
+ * @param issue Issue de la partie.
+ */
+void remplirImage(ImageSpectateur *image, const Partie *p, uint32_t tick, IssuePartie issue) {
+    image->tick = tick;
+    image->tailleSerpent = p->tailleSerpent;
+    image->pommesMangees = p->pommesMangees;
+    image->direction = p->direction;
+    image->issue = issue;
+    image->empreinte = empreintePartie(p);
+    image->teteX = CASEX(SEGMENT(p, 0));
+    image->teteY = CASEY(SEGMENT(p, 0));
+    memcpy(image->plateau, p->plateau, sizeof(image->plateau));
+}
+
+/**
+ * @brief Détache la partie de sa tribune et retire son nom ; les
+ * spectateurs déjà installés gardent leur vue sur la dernière image.
+ * @param t Tribune.
+ * @param nom Nom donné à ouvrirTribune().
+ */
+void fermerTribune(Tribune *t, const char *nom) {
+    char chemin[256];
+    cheminTribune(nom, chemin);
+    munmap(t, sizeof(Tribune));
+    shm_unlink(chemin);
+}
+
+/**
+ * @brief Projette en lecture seule la tribune d'une partie.
+ * @param nom Nom de la mémoire partagée.
+ * @return La tribune, ou NULL si elle n'existe pas ou a été écrite
+ * par un programme compilé avec un autre plateau.
+ */
+const Tribune *rejoindreTribune(const char *nom) {
+    char chemin[256];
+    cheminTribune(nom, chemin);
+    int fd = shm_open(chemin, O_RDONLY, 0);
+    if (fd < 0) return NULL;
+    struct stat etat;
+    if (fstat(fd, &etat) < 0 || etat.st_size != (off_t)sizeof(Tribune)) {
+        close(fd);
+        return NULL;
+    }
+    const Tribune *t = mmap(NULL, sizeof(Tribune), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (t == MAP_FAILED) return NULL;
+    if (memcmp(t->magie, MAGIETRIBUNE, sizeof(t->magie)) != 0 ||
+        t->largeur != LARGEURMAX || t->hauteur != HAUTEURMAX ||
+        t->nbImages != NBIMAGESTRIBUNE || t->tailleImage != sizeof(ImageSpectateur)) {
+        munmap((void *)t, sizeof(Tribune));
+        return NULL;
+    }
+    atomic_thread_fence(memory_order_acquire);
+    return t;
+}
+
+/**
+ * @brief Copie une image de la tribune sans jamais bloquer la partie.
+ * @param t Tribune.
+ * @param numero Rang de l'image voulue.
+ * @param image Copie de l'image.
+ * @return 1 si la copie est cohérente, 0 si l'image n'est pas encore
+ * publiée (ou en cours d'écriture), -1 si elle a déjà été écrasée.
+ *
+ * Un enregistreur suit les numéros un à un et compte ses pertes ;
+ * un tableau de bord lit seulement le dernier numéro publié.
+ */
+int lireImage(const Tribune *t, uint64_t numero, ImageSpectateur *image) {
+    const CaseTribune *c = &t->cases[numero % NBIMAGESTRIBUNE];
+    uint64_t avant = atomic_load_explicit(&c->sequence, memory_order_acquire);
+    if (avant < 2 * numero + 2) return 0;
+    if (avant > 2 * numero + 2) return -1;
+    memcpy(image, &c->image, sizeof(*image));
+    /** la copie est finie avant de relire la séquence */
+    atomic_thread_fence(memory_order_acquire);
+    uint64_t apres = atomic_load_explicit(&c->sequence, memory_order_relaxed);
+    return apres == avant ? 1 : -1;
+}
+
+/**
+ * @brief Regarde dans le terminal une partie publiée par --publier,
+ * jusqu'à sa dernière image.
+ * @param nom Nom de la tribune.
+ *
+ * Le spectateur affiche toujours l'image la plus récente : quand la
+ * partie va plus vite que lui, les images intermédiaires sont sautées
+ * et comptées. Si une nouvelle partie reprend le nom d'une partie
+ * interrompue, il passe à la sienne.
+ */
+void regarderPartie(const char *nom) {
+    ImageSpectateur image;
+    const Tribune *t = rejoindreTribune(nom);
+    if (t == NULL) {
+        fprintf(stderr, "Tribune introuvable : %s\n", nom);
+        return;
+    }
+    uint64_t suivante = 0, vues = 0, sautees = 0;
+    do {
+        if (atomic_load_explicit(&t->remplacee, memory_order_acquire)) {
+            const Tribune *nouvelle = rejoindreTribune(nom);
+            if (nouvelle == NULL) {
+                /** pas encore prête */
+                usleep(DELAISPECTATEUR);
+                continue;
+            }
+            munmap((void *)t, sizeof(Tribune));
+            t = nouvelle;
+            suivante = 0;
+        }
+        uint64_t publiees = atomic_load_explicit(&t->publiees, memory_order_acquire);
+        if (publiees <= suivante || lireImage(t, publiees - 1, &image) != 1) {
+            usleep(DELAISPECTATEUR);
+            continue;
+        }
+        sautees += publiees - 1 - suivante;
+        suivante = publiees;
+        vues++;
+        dessinerCases(image.plateau);
+        printf("tick %u, %d pommes, taille %d\n", image.tick, image.pommesMangees, image.tailleSerpent);
+        fflush(stdout);
+        usleep(DELAISPECTATEUR);
+    } while (vues == 0 || image.issue == PARTIE_EN_COURS);
+    printf("Partie %s : %lu images vues, %lu sautées.\n",
+           image.issue == PARTIE_PERDUE ? "perdue" : image.issue == PARTIE_GAGNEE ? "gagnée" : "abandonnée",
+           (unsigned long)vues, (unsigned long)sautees);
+    munmap((void *)t, sizeof(Tribune));
+}
+
+/*****************************************************
+*             RENDU DANS UN FIL A PART               *
+*****************************************************/
+
+/**
+ * @brief Repère dans les réponses du terminal celle à DECRQM pour le
+ * mode 2026 ("ESC[?2026;v$y") et celle à DA1 ("ESC[?...c").
+ * @param reponses Octets reçus.
+ * @param n Nombre d'octets reçus.
+ * @param etat Reçoit v si la réponse à DECRQM est arrivée.
+ * @return true si la réponse à DA1, toujours la dernière, est arrivée.
+ */
+static bool lireReponsesTerminal(const char *reponses, size_t n, int *etat) {
+    for (size_t i = 0; i + 3 < n; i++) {
+        if (reponses[i] != '\033' || reponses[i + 1] != '[' || reponses[i + 2] != '?') continue;
+        size_t j = i + 3;
+        while (j < n && ((reponses[j] >= '0' && reponses[j] <= '9') || reponses[j] == ';')) j++;
+        if (j == n) return false;
+        if (reponses[j] == 'c') return true;
+        if (reponses[j] == '$' && strncmp(reponses + i + 3, "2026;", 5) == 0) {
+            *etat = atoi(reponses + i + 8);
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Demande au terminal s'il connaît le mode 2026.
+ * @return true s'il le connaît.
+ *
+ * La demande DECRQM est suivie d'une demande DA1, à laquelle tous les
+ * terminaux répondent : l'attente s'arrête à cette réponse, même chez
+ * un terminal qui ignore DECRQM, ou au bout de DELAIDETECTION.
+ */
+static bool demanderSynchronisation(void) {
+    static const char demande[] = "\033[?2026$p\033[c";
+    struct termios avant, brut;
+    char reponses[256];
+    size_t lus = 0;
+    int etat = 0;
+    bool fini = false;
+    tcgetattr(STDIN_FILENO, &avant);
+    brut = avant;
+    brut.c_lflag &= ~(ICANON | ECHO);
+    tcsetattr(STDIN_FILENO, TCSANOW, &brut);
+    if (write(STDOUT_FILENO, demande, sizeof(demande) - 1) == (ssize_t)sizeof(demande) - 1) {
+        struct pollfd attente = { .fd = STDIN_FILENO, .events = POLLIN };
+        while (!fini && lus < sizeof(reponses) && poll(&attente, 1, DELAIDETECTION) > 0) {
+            ssize_t n = read(STDIN_FILENO, reponses + lus, sizeof(reponses) - lus);
+            if (n <= 0) break;
+            lus += n;
+            fini = lireReponsesTerminal(reponses, lus, &etat);
+        }
+    }
+    /** une réponse arrivée après le délai serait lue comme des touches */
+    tcflush(STDIN_FILENO, TCIFLUSH);
+    tcsetattr(STDIN_FILENO, TCSANOW, &avant);
+    /** 1 et 3 : mode actif, 2 : connu mais inactif ; 0 et 4 : inconnu */
+    return etat >= 1 && etat <= 3;
+}
+
+/**
+ * @brief Ajoute une séquence d'échappement à une chaîne de Terminal.
+ * @param chaine Chaîne à compléter.
+ * @param taille Longueur de la chaîne, mise à jour.
+ * @param sequence Séquence à ajouter.
+ */
+static void ajouterSequence(char *chaine, size_t *taille, const char *sequence) {
+    size_t longueur = strlen(sequence);
+    memcpy(chaine + *taille, sequence, longueur);
+    *taille += longueur;
+}
+
+/**
+ * @brief Indique si la locale demande de l'UTF-8.
+ * @return true pour une locale UTF-8.
+ */
+static bool localeUnicode(void) {
+    const char *variables[] = {"LC_ALL", "LC_CTYPE", "LANG"};
+    for (int k = 0; k < 3; k++) {
+        const char *locale = getenv(variables[k]);
+        if (locale == NULL || locale[0] == '\0') continue;
+        /** la première variable définie l'emporte */
+        return strstr(locale, "UTF-8") != NULL || strstr(locale, "utf-8") != NULL ||
+               strstr(locale, "UTF8") != NULL || strstr(locale, "utf8") != NULL;
+    }
+    return false;
+}
+
+/**
+ * @brief Fixe le dessin d'une apparence.
+ * @param a Apparence.
+ * @param couleur Sa couleur, ignorée sans couleurs.
+ * @param glyphe Son glyphe UTF-8, ignoré sans Unicode ; NULL pour le
+ * caractère du plateau.
+ */
+static void definirApparence(Apparence a, Couleur couleur, const char *glyphe) {
+    terminal.couleursGlyphes[a] = terminal.enCouleurs ? couleur : COULEUR_INDIFFERENTE;
+    if (terminal.unicode && glyphe != NULL) {
+        terminal.taillesGlyphes[a] = strlen(glyphe);
+        memcpy(terminal.glyphes[a], glyphe, terminal.taillesGlyphes[a]);
+    }
+}
+
+/**
+ * @brief Fixe la séquence d'une couleur.
+ * @param couleur Couleur.
+ * @param vraie Séquence en 24 bits.
+ * @param ansi Séquence parmi les 16 couleurs ANSI.
+ */
+static void definirCouleur(Couleur couleur, const char *vraie, const char *ansi) {
+    const char *sequence = terminal.vraiesCouleurs ? vraie : ansi;
+    terminal.taillesCouleurs[couleur] = strlen(sequence);
+    memcpy(terminal.sequencesCouleurs[couleur], sequence, terminal.taillesCouleurs[couleur]);
+}
+
+/**
+ * @brief Précalcule le dessin de chaque état de case : séquence de
+ * couleur et glyphe, et forme de chaque CARBORDURE selon sa place (les
+ * bords du plateau sont tracés, l'intérieur est fait de pavés).
+ */
+static void construireApparences(void) {
+    terminal.apparences[(unsigned char)VIDE] = APPARENCE_VIDE;
+    terminal.apparences[(unsigned char)TETE] = APPARENCE_TETE;
+    terminal.apparences[(unsigned char)CORPS] = APPARENCE_CORPS;
+    terminal.apparences[(unsigned char)POMME] = APPARENCE_POMME;
+    for (int i = 0; i < HAUTEURMAX; i++) {
+        for (int j = 0; j < LARGEURMAX; j++) {
+            bool haut = i == 0, bas = i == HAUTEURMAX - 1;
+            bool gauche = j == 0, droite = j == LARGEURMAX - 1;
+            Apparence a = APPARENCE_PAVE;
+            if (haut || bas) a = APPARENCE_BORD_HORIZONTAL;
+            if (gauche || droite) a = APPARENCE_BORD_VERTICAL;
+            if (haut && gauche) a = APPARENCE_COIN_HAUT_GAUCHE;
+            if (haut && droite) a = APPARENCE_COIN_HAUT_DROIT;
+            if (bas && gauche) a = APPARENCE_COIN_BAS_GAUCHE;
+            if (bas && droite) a = APPARENCE_COIN_BAS_DROIT;
+            terminal.formesBordure[i][j] = a;
+        }
+    }
+
+    /** le serpent est d'une seule couleur : d'une image à l'autre, la
+     * couleur en cours est presque toujours déjà la bonne */
+    definirApparence(APPARENCE_CARACTERE, COULEUR_NORMALE, NULL);
+    definirApparence(APPARENCE_VIDE, COULEUR_INDIFFERENTE, NULL);
+    definirApparence(APPARENCE_TETE, COULEUR_SERPENT, "◉");
+    definirApparence(APPARENCE_CORPS, COULEUR_SERPENT, "█");
+    definirApparence(APPARENCE_POMME, COULEUR_POMME, "●");
+    /** les pavés changent de place à chaque pomme : ils gardent leur
+     * caractère d'un octet, seule leur couleur les distingue */
+    definirApparence(APPARENCE_PAVE, COULEUR_PAVE, NULL);
+    definirApparence(APPARENCE_BORD_HORIZONTAL, COULEUR_BORDURE, "─");
+    definirApparence(APPARENCE_BORD_VERTICAL, COULEUR_BORDURE, "│");
+    definirApparence(APPARENCE_COIN_HAUT_GAUCHE, COULEUR_BORDURE, "┌");
+    definirApparence(APPARENCE_COIN_HAUT_DROIT, COULEUR_BORDURE, "┐");
+    definirApparence(APPARENCE_COIN_BAS_GAUCHE, COULEUR_BORDURE, "└");
+    definirApparence(APPARENCE_COIN_BAS_DROIT, COULEUR_BORDURE, "┘");
+
+    if (!terminal.enCouleurs) return;
+    definirCouleur(COULEUR_NORMALE, "\033[39m", "\033[39m");
+    /** serpent et pomme alternent à chaque pomme mangée : leurs séquences
+     * restent courtes, les vraies couleurs sont pour le décor, dessiné
+     * une fois */
+    definirCouleur(COULEUR_SERPENT, "\033[32m", "\033[32m");
+    definirCouleur(COULEUR_POMME, "\033[91m", "\033[91m");
+    definirCouleur(COULEUR_PAVE, "\033[38;2;170;120;70m", "\033[33m");
+    definirCouleur(COULEUR_BORDURE, "\033[38;2;110;130;170m", "\033[36m");
+}
+
+/**
+ * @brief Code un changement de couleur, s'il y a lieu.
+ * @param o Où écrire.
+ * @param couleur Couleur en cours dans le terminal, mise à jour.
+ * @param voulue Couleur voulue.
+ * @return La suite de o.
+ */
+static char *coderCouleur(char *o, uint8_t *couleur, uint8_t voulue) {
+    if (voulue == COULEUR_INDIFFERENTE || voulue == *couleur) return o;
+    memcpy(o, terminal.sequencesCouleurs[voulue], terminal.taillesCouleurs[voulue]);
+    *couleur = voulue;
+    return o + terminal.taillesCouleurs[voulue];
+}
+
+/**
+ * @brief Code une case : sa couleur si elle diffère de celle en cours,
+ * puis son glyphe, tous deux tirés des tables de la variable terminal.
+ * @param o Où écrire.
+ * @param couleur Couleur en cours dans le terminal, mise à jour.
+ * @param c Caractère du plateau.
+ * @param i Ligne de la case.
+ * @param j Colonne de la case.
+ * @return La suite de o.
+ */
+char *coderCase(char *o, uint8_t *couleur, char c, int i, int j) {
+    uint8_t a = c == CARBORDURE ? terminal.formesBordure[i][j] : terminal.apparences[(unsigned char)c];
+    o = coderCouleur(o, couleur, terminal.couleursGlyphes[a]);
+    if (terminal.taillesGlyphes[a] == 0) {
+        *o++ = c;
+        return o;
+    }
+    memcpy(o, terminal.glyphes[a], sizeof(terminal.glyphes[a]));
+    return o + terminal.taillesGlyphes[a];
+}
+
+/**
+ * @brief Détecte les capacités du terminal et assemble les séquences de
+ * la variable terminal ; à appeler une fois, avant tout dessin.
+ *
+ * Sortie qui n'est pas un terminal ou terminal "dumb" : aucune
+ * capacité. L'écran alterné et le curseur caché sont admis de tous les
+ * autres ; le mode 2026 est demandé au terminal si le clavier en est un
+ * aussi, les vraies couleurs sont annoncées par COLORTERM, les couleurs
+ * retirées par NO_COLOR, les glyphes Unicode permis par la locale.
+ */
+void detecterTerminal(void) {
+    const char *nom = getenv("TERM");
+    const char *couleurs = getenv("COLORTERM");
+    memset(&terminal, 0, sizeof(terminal));
+    if (!isatty(STDOUT_FILENO) || nom == NULL || strcmp(nom, "dumb") == 0) return;
+    terminal.ecranAlterne = true;
+    terminal.curseurCache = true;
+    terminal.vraiesCouleurs = couleurs != NULL &&
+        (strcmp(couleurs, "truecolor") == 0 || strcmp(couleurs, "24bit") == 0);
+    terminal.synchronise = isatty(STDIN_FILENO) && demanderSynchronisation();
+    const char *sansCouleur = getenv("NO_COLOR");
+    terminal.enCouleurs = sansCouleur == NULL || sansCouleur[0] == '\0';
+    terminal.unicode = localeUnicode();
+    construireApparences();
+    struct winsize taille;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &taille) == 0) {
+        terminal.lignes = taille.ws_row;
+        terminal.colonnes = taille.ws_col;
+    }
+
+    if (terminal.synchronise) {
+        ajouterSequence(terminal.debutImage, &terminal.tailleDebutImage, "\033[?2026h");
+        ajouterSequence(terminal.finImage, &terminal.tailleFinImage, "\033[?2026l");
+    }
+    ajouterSequence(terminal.entree, &terminal.tailleEntree, "\033[?1049h");
+    ajouterSequence(terminal.entree, &terminal.tailleEntree, "\033[?25l");
+    if (terminal.enCouleurs) ajouterSequence(terminal.sortie, &terminal.tailleSortie, "\033[0m");
+    ajouterSequence(terminal.sortie, &terminal.tailleSortie, "\033[?25h");
+    ajouterSequence(terminal.sortie, &terminal.tailleSortie, "\033[?1049l");
+}
+
+/**
+ * @brief Ouvre pour le fil de rendu une sortie non bloquante vers le
+ * terminal. Elle est rouverte plutôt que dupliquée : O_NONBLOCK sur le
+ * descripteur 1 toucherait aussi l'entrée clavier, qui partage souvent
+ * la même ouverture du terminal.
+ * @return Le descripteur ; un double bloquant de la sortie standard
+ * si elle est un fichier ou ne peut pas être rouverte.
+ */
+static int ouvrirSortieRendu(void) {
+    struct stat etat;
+    if (fstat(STDOUT_FILENO, &etat) == 0 && !S_ISREG(etat.st_mode)) {
+        int fd = open("/proc/self/fd/1", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd >= 0) return fd;
+    }
+    return dup(STDOUT_FILENO);
+}
+
+/**
+ * @brief Code les cases qui ont changé entre l'écran et une image :
+ * déplacements du curseur et cases modifiées seulement.
+ * @param r Rendu.
+ * @param image Image à dessiner.
+ * @param o Où écrire.
+ * @return La suite de o.
+ */
+static char *coderCasesModifiees(Rendu *r, const ImageSpectateur *image, char *o) {
+    for (int i = 0; i < r->vueLignes; i++) {
+        int colonne = -1;
+        int y = r->origineY + i;
+        const char *ligne = &image->plateau[y][r->origineX];
+        for (int j = 0; j < r->vueColonnes; j++) {
+            char c = ligne[j];
+            if (c == r->ecran[i][j]) continue;
+            if (colonne >= 0 && j > colonne && j - colonne <= ECARTRECOPIE) {
+                for (int k = colonne; k < j; k++) {
+                    o = coderCase(o, &r->couleur, ligne[k], y, r->origineX + k);
+                }
+            } else if (j != colonne) {
+                o += sprintf(o, "\033[%d;%dH", i + 1, j + 1);
+            }
+            o = coderCase(o, &r->couleur, c, y, r->origineX + j);
+            r->ecran[i][j] = c;
+            colonne = j + 1;
+        }
+    }
+    return o;
+}
+
+/**
+ * @brief Place la caméra sur un axe : la tête reste dans la moitié
+ * centrale de la vue, la caméra la suivant case par case ; une tête
+ * sortie de la vue (issue, portail, retour en arrière) est recentrée.
+ * @param origine Origine actuelle de la vue sur l'axe.
+ * @param tete Position de la tête sur l'axe.
+ * @param vue Taille de la vue sur l'axe.
+ * @param taille Taille du plateau sur l'axe.
+ * @return La nouvelle origine, la vue restant dans le plateau.
+ */
+static int suivreTete(int origine, int tete, int vue, int taille) {
+    int marge = vue / 4;
+    if (tete < origine || tete >= origine + vue) {
+        origine = tete - vue / 2;
+    } else if (tete < origine + marge) {
+        origine = tete - marge;
+    } else if (tete > origine + vue - 1 - marge) {
+        origine = tete - (vue - 1 - marge);
+    }
+    if (origine > taille - vue) origine = taille - vue;
+    if (origine < 0) origine = 0;
+    return origine;
+}
+
+/**
+ * @brief Compte les cases qu'il faudrait redessiner sur une ligne de la
+ * vue, après un éventuel glissement horizontal.
+ * @param montree Ligne montrée par le terminal, NULL pour une ligne vide.
+ * @param decalage Glissement vers la gauche (négatif : vers la droite).
+ * @param voulue Ligne à montrer.
+ * @param n Largeur de la vue.
+ * @return Nombre de cases différentes.
+ */
+static int differencesLigne(const char *montree, int decalage, const char *voulue, int n) {
+    int d = 0;
+    for (int j = 0; j < n; j++) {
+        int k = j + decalage;
+        char c = montree != NULL && k >= 0 && k < n ? montree[k] : VIDE;
+        d += c != voulue[j];
+    }
+    return d;
+}
+
+/**
+ * @brief Déplace la caméra vers la tête en faisant glisser ce que montre
+ * le terminal plutôt qu'en le redessinant : les lignes défilent dans la
+ * région de défilement (DECSTBM, posée sur la vue) par SU ou SD, les
+ * colonnes par suppression (DCH) ou insertion (ICH) de caractères en
+ * début de ligne. Chaque glissement n'est fait que s'il épargne plus de
+ * COUTDEFILEMENT cases à redessiner (sur un plateau presque vide, le
+ * redessin des seules cases modifiées coûte souvent moins). L'écran
+ * mémorisé glisse de même ; les cases découvertes sont ensuite dessinées
+ * par coderCasesModifiees comme toute case modifiée.
+ * @param r Rendu.
+ * @param image Image à dessiner.
+ * @param o Où écrire.
+ * @return La suite de o.
+ */
+static char *deplacerCamera(Rendu *r, const ImageSpectateur *image, char *o) {
+    int y = suivreTete(r->origineY, image->teteY, r->vueLignes, HAUTEURMAX);
+    int x = suivreTete(r->origineX, image->teteX, r->vueColonnes, LARGEURMAX);
+    int dy = y - r->origineY, dx = x - r->origineX;
+    int n = r->vueColonnes;
+    r->origineY = y;
+    r->origineX = x;
+    /** au-delà d'une vue, rien n'est à garder : tout se redessine */
+    if (abs(dy) >= r->vueLignes) dy = 0;
+    if (abs(dx) >= n) dx = 0;
+    if (dy == 0 && dx == 0) return o;
+
+    /** coût de la vue avec et sans défilement vertical, chaque ligne
+     * glissant ou non horizontalement selon ce qui lui coûte le moins */
+    long couts[2] = {0, COUTDEFILEMENT};
+    for (int v = 0; v < 2 && (v == 0 || dy != 0); v++) {
+        for (int i = 0; i < r->vueLignes; i++) {
+            int source = i + (v ? dy : 0);
+            const char *montree = source >= 0 && source < r->vueLignes ? r->ecran[source] : NULL;
+            const char *voulue = &image->plateau[y + i][x];
+            int sans = differencesLigne(montree, 0, voulue, n);
+            int avec = dx != 0 ? differencesLigne(montree, dx, voulue, n) + COUTDEFILEMENT : sans;
+            couts[v] += sans < avec ? sans : avec;
+        }
+    }
+    bool defile = false;
+    if (dy != 0 && couts[1] < couts[0]) {
+        int gardees = r->vueLignes - abs(dy);
+        o += sprintf(o, dy > 0 ? "\033[%dS" : "\033[%dT", abs(dy));
+        if (dy > 0) {
+            memmove(r->ecran[0], r->ecran[dy], gardees * sizeof(r->ecran[0]));
+            memset(r->ecran[gardees], VIDE, dy * sizeof(r->ecran[0]));
+        } else {
+            memmove(r->ecran[-dy], r->ecran[0], gardees * sizeof(r->ecran[0]));
+            memset(r->ecran[0], VIDE, -dy * sizeof(r->ecran[0]));
+        }
+        defile = true;
+    }
+    for (int i = 0; dx != 0 && i < r->vueLignes; i++) {
+        char *ligne = r->ecran[i];
+        const char *voulue = &image->plateau[y + i][x];
+        if (differencesLigne(ligne, dx, voulue, n) + COUTDEFILEMENT >= differencesLigne(ligne, 0, voulue, n)) {
+            continue;
+        }
+        o += sprintf(o, "\033[%d;1H\033[%d%c", i + 1, abs(dx), dx > 0 ? 'P' : '@');
+        if (dx > 0) {
+            memmove(ligne, ligne + dx, n - dx);
+            memset(ligne + n - dx, VIDE, dx);
+        } else {
+            memmove(ligne - dx, ligne, n + dx);
+            memset(ligne, VIDE, -dx);
+        }
+        defile = true;
+    }
+    if (defile) r->defilements++;
+    return o;
+}
+
+/**
+ * @brief Répartit 16 bits consécutifs d'une ligne de points en 8
+ * octets : l'octet k reçoit les bits 2k et 2k + 1 dans ses bits 0 et 1.
+ * @param bits Les 16 bits.
+ * @return Les 8 octets, l'octet 0 en poids faible.
+ */
+static inline uint64_t repartirPaires(uint64_t bits) {
+    bits = (bits | bits << 24) & 0x000000FF000000FFULL;
+    bits = (bits | bits << 12) & 0x000F000F000F000FULL;
+    bits = (bits | bits << 6) & 0x0303030303030303ULL;
+    return bits;
+}
+
+/**
+ * @brief Calcule 8 caractères braille côte à côte à partir de 16
+ * colonnes de points sur 4 lignes.
+ * @param b Bitboard des points.
+ * @param y Première des 4 lignes de points.
+ * @param nbLignes Lignes de points du bitboard (au-delà, aucun point).
+ * @param groupe Rang des 16 colonnes (colonnes 16 * groupe et suivantes).
+ * @return Les 8 motifs (bits des points 1 à 8 du braille Unicode),
+ * le caractère de gauche en poids faible.
+ *
+ * Le point (ligne r, colonne c) du caractère va au bit r + 3c pour les
+ * lignes 0 à 2 et au bit 6 + c pour la ligne 3 : chaque ligne, une fois
+ * ses paires de bits réparties par octet, se place par deux masques.
+ */
+static uint64_t motifsBraille(const Bitboard *b, int y, int nbLignes, int groupe) {
+    const uint64_t gauche = 0x0101010101010101ULL, droite = gauche << 1;
+    uint64_t r[4];
+    for (int k = 0; k < 4; k++) {
+        r[k] = y + k < nbLignes
+             ? repartirPaires((b->ligne[y + k][groupe / 4] >> (16 * (groupe % 4))) & 0xFFFF)
+             : 0;
+    }
+    return (r[0] & gauche) | (r[0] & droite) << 2
+         | (r[1] & gauche) << 1 | (r[1] & droite) << 3
+         | (r[2] & gauche) << 2 | (r[2] & droite) << 4
+         | r[3] << 6;
+}
+
+/**
+ * @brief Code les caractères braille qui ont changé entre l'écran et
+ * une image réduite : chaque point couvre echelle x echelle cases, un
+ * caractère 2 x 4 points. Pour la couleur d'un caractère, la pomme
+ * l'emporte sur le serpent, et le serpent sur le décor.
+ * @param r Rendu.
+ * @param image Image à dessiner.
+ * @param o Où écrire.
+ * @return La suite de o.
+ */
+static char *coderBraille(Rendu *r, const ImageSpectateur *image, char *o) {
+    int lignesPoints = (HAUTEURMAX + r->echelle - 1) / r->echelle;
+    size_t tailleLignes = lignesPoints * sizeof(r->pointsDecor.ligne[0]);
+    memset(r->pointsDecor.ligne, 0, tailleLignes);
+    memset(r->pointsSerpent.ligne, 0, tailleLignes);
+    memset(r->pointsPomme.ligne, 0, tailleLignes);
+    for (int i = 0; i < HAUTEURMAX; i++) {
+        int y = i / r->echelle;
+        for (int j = 0; j < LARGEURMAX; j++) {
+            char c = image->plateau[i][j];
+            if (c == VIDE) continue;
+            int x = j / r->echelle;
+            Bitboard *b = c == POMME ? &r->pointsPomme
+                        : c == TETE || c == CORPS ? &r->pointsSerpent : &r->pointsDecor;
+            b->ligne[y][x / 64] |= (uint64_t)1 << (x % 64);
+        }
+    }
+
+    for (int ligne = 0; ligne < r->lignesBraille; ligne++) {
+        int colonne = -1;
+        for (int groupe = 0; 8 * groupe < r->colonnesBraille; groupe++) {
+            uint64_t decor = motifsBraille(&r->pointsDecor, 4 * ligne, lignesPoints, groupe);
+            uint64_t serpent = motifsBraille(&r->pointsSerpent, 4 * ligne, lignesPoints, groupe);
+            uint64_t pomme = motifsBraille(&r->pointsPomme, 4 * ligne, lignesPoints, groupe);
+            uint64_t montres;
+            memcpy(&montres, &r->pointsEcran[ligne][8 * groupe], sizeof(montres));
+            /** 8 caractères vides à l'écran comme dans l'image : rien à faire */
+            if ((decor | serpent | pomme | montres) == 0) continue;
+            for (int k = 0; k < 8 && 8 * groupe + k < r->colonnesBraille; k++) {
+                int x = 8 * groupe + k;
+                uint8_t points = (decor | serpent | pomme) >> (8 * k);
+                uint8_t couleur = (uint8_t)(pomme >> (8 * k)) ? COULEUR_POMME
+                                : (uint8_t)(serpent >> (8 * k)) ? COULEUR_SERPENT
+                                : points ? COULEUR_BORDURE : COULEUR_INDIFFERENTE;
+                if (!terminal.enCouleurs) couleur = COULEUR_INDIFFERENTE;
+                if (points == r->pointsEcran[ligne][x] && couleur == r->couleursEcran[ligne][x]) {
+                    continue;
+                }
+                if (x != colonne) o += sprintf(o, "\033[%d;%dH", ligne + 1, x + 1);
+                o = coderCouleur(o, &r->couleur, couleur);
+                if (points == 0) {
+                    *o++ = ' ';
+                } else {
+                    /** U+2800 + motif, en UTF-8 */
+                    *o++ = (char)0xE2;
+                    *o++ = (char)(0xA0 | points >> 6);
+                    *o++ = (char)(0x80 | (points & 0x3F));
+                }
+                r->pointsEcran[ligne][x] = points;
+                r->couleursEcran[ligne][x] = couleur;
+                colonne = x + 1;
+            }
+        }
+    }
+    return o;
+}
+
+/**
+ * @brief Code les changements entre ce que montre le terminal et une
+ * image, case par case ou en braille selon r->echelle.
+ * @param r Rendu, dont le tampon reçoit l'image à envoyer.
+ * @param image Image à dessiner.
+ */
+static void coderDifferences(Rendu *r, const ImageSpectateur *image) {
+    char *o = r->tampon;
+    memcpy(o, terminal.debutImage, terminal.tailleDebutImage);
+    o += terminal.tailleDebutImage;
+    char *debut = o;
+    if (!r->ecranConnu) {
+        memcpy(o, terminal.entree, terminal.tailleEntree);
+        o += terminal.tailleEntree;
+        /** la région de défilement de la caméra : DECSTBM ramène le
+         * curseur en haut, l'effacement qui suit ne déplace rien */
+        if (r->camera) o += sprintf(o, "\033[1;%dr", r->vueLignes);
+        o += sprintf(o, "\033[H\033[2J");
+        memset(r->ecran, VIDE, sizeof(r->ecran));
+        memset(r->pointsEcran, 0, sizeof(r->pointsEcran));
+        memset(r->couleursEcran, COULEUR_INDIFFERENTE, sizeof(r->couleursEcran));
+        r->ecranConnu = true;
+        r->couleur = COULEUR_INDIFFERENTE;
+        if (r->camera) {
+            r->origineY = suivreTete(-HAUTEURMAX, image->teteY, r->vueLignes, HAUTEURMAX);
+            r->origineX = suivreTete(-LARGEURMAX, image->teteX, r->vueColonnes, LARGEURMAX);
+        }
+    }
+    if (r->camera) o = deplacerCamera(r, image, o);
+    o = r->echelle > 0 ? coderBraille(r, image, o) : coderCasesModifiees(r, image, o);
+    if (o == debut) {
+        /** rien n'a changé : rien à envoyer */
+        o = r->tampon;
+    } else {
+        /** un curseur visible attend sous le plateau, comme après un dessin complet */
+        if (!terminal.curseurCache) {
+            o += sprintf(o, "\033[%d;1H", (r->echelle > 0 ? r->lignesBraille : r->vueLignes) + 1);
+        }
+        memcpy(o, terminal.finImage, terminal.tailleFinImage);
+        o += terminal.tailleFinImage;
+    }
+    r->aEnvoyer = o - r->tampon;
+    r->envoyes = 0;
+    r->retenue = false;
+}
+
+/**
+ * @brief Envoie au terminal ce qu'il veut bien prendre de l'image en
+ * cours, sans jamais attendre.
+ * @param r Rendu.
+ */
+static void envoyerRendu(Rendu *r) {
+    while (r->envoyes < r->aEnvoyer) {
+        ssize_t n = write(r->sortie, r->tampon + r->envoyes, r->aEnvoyer - r->envoyes);
+        if (n > 0) {
+            r->envoyes += n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (!r->retenue) r->retenues++;
+            r->retenue = true;
+            return;
+        } else {
+            /** terminal disparu : l'image est abandonnée */
+            r->envoyes = r->aEnvoyer;
+        }
+    }
+}
+
+/**
+ * @brief Corps du fil de rendu : envoie la différence entre l'écran et
+ * l'image la plus récente, jusqu'à l'arrêt demandé par arreterRendu.
+ * @param argument Le Rendu.
+ * @return NULL.
+ *
+ * Une image que le terminal n'a prise qu'en partie est terminée avant
+ * toute autre (une séquence d'échappement coupée dérèglerait l'écran) ;
+ * pendant ce temps les images publiées se remplacent dans le tampon du
+ * milieu, et la suivante envoyée va directement à la plus récente.
+ * Après l'arrêt, un terminal qui ne prend plus rien pendant
+ * DELAIARRETRENDU ms fait abandonner l'image en cours.
+ */
+static void *dessinerEnContinu(void *argument) {
+    Rendu *r = argument;
+    for (;;) {
+        if (r->envoyes < r->aEnvoyer) {
+            struct pollfd attente = { .fd = r->sortie, .events = POLLOUT };
+            /** attente bornée, pour voir l'arrêt même si le lecteur s'est figé */
+            if (poll(&attente, 1, DELAIARRETRENDU) == 0 &&
+                atomic_load_explicit(&r->arret, memory_order_acquire)) {
+                r->envoyes = r->aEnvoyer;
+                r->coupee = true;
+                return NULL;
+            }
+            envoyerRendu(r);
+            continue;
+        }
+        /** l'arrêt est lu avant le milieu : la dernière image,
+         * publiée avant l'arrêt, est donc toujours dessinée */
+        bool fin = atomic_load_explicit(&r->arret, memory_order_acquire);
+        if (atomic_load_explicit(&r->milieu, memory_order_relaxed) & IMAGENEUVE) {
+            uint8_t neuf = atomic_exchange_explicit(&r->milieu, r->lecture, memory_order_acq_rel);
+            r->lecture = neuf & ~IMAGENEUVE;
+            coderDifferences(r, &r->images[r->lecture]);
+            if (r->enregistrement != NULL) enregistrer(r->enregistrement, r->tampon, r->aEnvoyer);
+            envoyerRendu(r);
+            continue;
+        }
+        if (fin) return NULL;
+        sem_wait(&r->signal);
+    }
+}
+
+/**
+ * @brief Choisit entre le dessin case par case et la vue réduite en
+ * braille, et l'échelle de celle-ci : la plus petite qui fasse tenir le
+ * plateau dans le terminal (une ligne restant libre en bas).
+ * @param r Rendu.
+ * @param braille Vue réduite demandée même si le plateau tient.
+ */
+static void choisirEchelle(Rendu *r, bool braille) {
+    int colonnes = terminal.colonnes, lignes = terminal.lignes - 1;
+    bool tient = colonnes <= 0 || (LARGEURMAX <= colonnes && HAUTEURMAX <= lignes);
+    r->echelle = 0;
+    r->camera = false;
+    r->vueLignes = HAUTEURMAX;
+    r->vueColonnes = LARGEURMAX;
+    r->origineY = r->origineX = 0;
+    /** le braille demande de l'UTF-8 */
+    if ((tient && !braille) || !terminal.unicode) return;
+    int e = 1;
+    while (colonnes > 0 && lignes > 0 &&
+           ((LARGEURMAX + 2 * e - 1) / (2 * e) > colonnes ||
+            (HAUTEURMAX + 4 * e - 1) / (4 * e) > lignes)) {
+        e++;
+    }
+    r->echelle = e;
+    r->colonnesBraille = ((LARGEURMAX + e - 1) / e + 1) / 2;
+    r->lignesBraille = ((HAUTEURMAX + e - 1) / e + 3) / 4;
+}
+
+/**
+ * @brief Remplace la vue du plateau entier par une fenêtre à la taille
+ * du terminal (une ligne restant libre en bas) qui suit la tête.
+ * @param r Rendu.
+ */
+static void choisirCamera(Rendu *r) {
+    /** taille du terminal inconnue : le plateau entier reste en vue */
+    if (terminal.colonnes <= 0 || terminal.lignes <= 1) return;
+    r->echelle = 0;
+    r->camera = true;
+    r->vueLignes = terminal.lignes - 1 < HAUTEURMAX ? terminal.lignes - 1 : HAUTEURMAX;
+    r->vueColonnes = terminal.colonnes < LARGEURMAX ? terminal.colonnes : LARGEURMAX;
+}
+
+/**
+ * @brief Démarre le fil de rendu.
+ * @param r Rendu à initialiser.
+ * @param braille Vue réduite en braille demandée (--braille) ; elle est
+ * prise d'office quand le plateau ne tient pas dans le terminal.
+ * @param camera Fenêtre qui suit la tête demandée (--camera), à la
+ * place de la vue réduite.
+ * @param e Enregistrement ouvert qui reçoit une copie des images
+ * envoyées (--enregistrer), ou NULL.
+ */
+void lancerRendu(Rendu *r, bool braille, bool camera, Enregistrement *e) {
+    r->ecriture = 0;
+    atomic_init(&r->milieu, 1);
+    r->lecture = 2;
+    atomic_init(&r->arret, false);
+    r->publiees = r->sautees = 0;
+    r->ecranConnu = false;
+    r->aEnvoyer = r->envoyes = 0;
+    r->coupee = false;
+    r->retenues = 0;
+    r->defilements = 0;
+    choisirEchelle(r, braille);
+    if (camera) choisirCamera(r);
+    r->enregistrement = e;
+    if (e != NULL) {
+        /** l'écran enregistré est celui du terminal, s'il est connu,
+         * agrandi au besoin jusqu'à la vue et la ligne du curseur */
+        int largeur = r->echelle > 0 ? r->colonnesBraille : r->vueColonnes;
+        int hauteur = (r->echelle > 0 ? r->lignesBraille : r->vueLignes) + 1;
+        commencerEnregistrement(e, largeur > terminal.colonnes ? largeur : terminal.colonnes,
+                                hauteur > terminal.lignes ? hauteur : terminal.lignes);
+    }
+    /** ce qui attend encore dans stdout passe avant le rendu */
+    fflush(stdout);
+    r->sortie = ouvrirSortieRendu();
+    sem_init(&r->signal, 0, 0);
+    pthread_create(&r->fil, NULL, dessinerEnContinu, r);
+}
+
+/**
+ * @brief Confie au fil de rendu l'image d'un tick ; ne bloque jamais,
+ * quelle que soit la lenteur du terminal ou du lecteur d'un tube.
+ * @param r Rendu.
+ * @param p Partie.
+ * @param tick Numéro du tick.
+ */
+void publierRendu(Rendu *r, const Partie *p, uint32_t tick) {
+    remplirImage(&r->images[r->ecriture], p, tick, PARTIE_EN_COURS);
+    uint8_t ancien = atomic_exchange_explicit(&r->milieu, r->ecriture | IMAGENEUVE,
+                                              memory_order_acq_rel);
+    /** l'image du milieu n'avait pas été prise : elle ne sera jamais dessinée */
+    if (ancien & IMAGENEUVE) r->sautees++;
+    r->ecriture = ancien & ~IMAGENEUVE;
+    r->publiees++;
+    sem_post(&r->signal);
+}
+
+/**
+ * @brief Arrête le fil de rendu après qu'il a dessiné la dernière image
+ * publiée, et rend au terminal son écran et son curseur.
+ * @param r Rendu.
+ *
+ * Un lecteur qui ne prend plus rien ne bloque pas la fin du jeu : après
+ * DELAIARRETRENDU ms sans progrès, l'image en cours puis, au besoin,
+ * la remise en état du terminal sont abandonnées.
+ */
+void arreterRendu(Rendu *r) {
+    atomic_store_explicit(&r->arret, true, memory_order_release);
+    sem_post(&r->signal);
+    pthread_join(r->fil, NULL);
+    if (r->ecranConnu && (terminal.tailleSortie > 0 || r->camera || r->coupee)) {
+        /** CAN annule la séquence d'échappement d'une image coupée, puis
+         * la région de défilement de la caméra est rendue au terminal entier */
+        size_t debut = r->coupee ? (size_t)sprintf(r->tampon, "\030") : 0;
+        size_t region = r->camera ? (size_t)sprintf(r->tampon + debut, "\033[r") : 0;
+        memcpy(r->tampon + debut + region, terminal.sortie, terminal.tailleSortie);
+        r->aEnvoyer = debut + region + terminal.tailleSortie;
+        r->envoyes = 0;
+        r->retenue = true;
+        if (r->enregistrement != NULL) enregistrer(r->enregistrement, r->tampon, r->aEnvoyer);
+        envoyerRendu(r);
+        while (r->envoyes < r->aEnvoyer) {
+            struct pollfd attente = { .fd = r->sortie, .events = POLLOUT };
+            if (poll(&attente, 1, DELAIARRETRENDU) == 0) break;
+            envoyerRendu(r);
+        }
+    }
+    sem_destroy(&r->signal);
+    close(r->sortie);
+}
+
+/*****************************************************
+*             ENREGISTREMENT ASCIICAST               *
+*****************************************************/
+
+/**
+ * @brief Écrit des octets comme contenu d'une chaîne JSON : guillemets,
+ * barres obliques inverses et caractères de contrôle sont échappés,
+ * l'UTF-8 du rendu passe tel quel.
+ * @param f Fichier.
+ * @param octets Octets à écrire.
+ * @param taille Nombre d'octets.
+ */
+static void ecrireChaineJson(FILE *f, const char *octets, size_t taille) {
+    char morceau[4096];
+    size_t n = 0;
+    for (size_t i = 0; i < taille; i++) {
+        unsigned char c = octets[i];
+        if (c == '"' || c == '\\') {
+            morceau[n++] = '\\';
+            morceau[n++] = c;
+        } else if (c < 0x20 || c == 0x7F) {
+            n += sprintf(morceau + n, "\\u%04x", c);
+        } else {
+            morceau[n++] = c;
+        }
+        if (n > sizeof(morceau) - 8) {
+            fwrite(morceau, 1, n, f);
+            n = 0;
+        }
+    }
+    fwrite(morceau, 1, n, f);
+}
+
+/**
+ * @brief Recopie des octets à la fin de la partie occupée de l'anneau,
+ * qui doit avoir la place ; verrou tenu.
+ * @param e Enregistrement.
+ * @param octets Octets à déposer.
+ * @param taille Nombre d'octets.
+ */
+static void deposerAnneau(Enregistrement *e, const void *octets, size_t taille) {
+    size_t fin = (e->debut + e->occupes) % TAILLEENREGISTREMENT;
+    size_t avant = TAILLEENREGISTREMENT - fin < taille ? TAILLEENREGISTREMENT - fin : taille;
+    memcpy(e->anneau + fin, octets, avant);
+    memcpy(e->anneau, (const char *)octets + avant, taille - avant);
+    e->occupes += taille;
+}
+
+/**
+ * @brief Retire des octets du début de la partie occupée de l'anneau ;
+ * verrou tenu.
+ * @param e Enregistrement.
+ * @param octets Destination.
+ * @param taille Nombre d'octets.
+ */
+static void retirerAnneau(Enregistrement *e, void *octets, size_t taille) {
+    size_t avant = TAILLEENREGISTREMENT - e->debut < taille ? TAILLEENREGISTREMENT - e->debut : taille;
+    memcpy(octets, e->anneau + e->debut, avant);
+    memcpy((char *)octets + avant, e->anneau, taille - avant);
+    e->debut = (e->debut + taille) % TAILLEENREGISTREMENT;
+    e->occupes -= taille;
+}
+
+/**
+ * @brief Corps du fil d'écriture : sort les images de l'anneau une à
+ * une et les écrit en événements asciicast, jusqu'à ce que
+ * fermerEnregistrement le demande et que l'anneau soit vide.
+ * @param argument L'Enregistrement.
+ * @return NULL.
+ *
+ * Le codage JSON et l'écriture se font verrou relâché : le fil de
+ * rendu n'attend jamais que la recopie d'une image hors de l'anneau.
+ */
+static void *ecrireEnContinu(void *argument) {
+    Enregistrement *e = argument;
+    pthread_mutex_lock(&e->verrou);
+    for (;;) {
+        if (e->occupes == 0) {
+            if (e->fin) break;
+            /** plus rien en attente : ce qui est écrit part sur le disque */
+            pthread_mutex_unlock(&e->verrou);
+            fflush(e->fichier);
+            pthread_mutex_lock(&e->verrou);
+            while (e->occupes == 0 && !e->fin) {
+                pthread_cond_wait(&e->images, &e->verrou);
+            }
+            continue;
+        }
+        EnteteEnregistrement entete;
+        retirerAnneau(e, &entete, sizeof(entete));
+        retirerAnneau(e, e->image, entete.taille);
+        pthread_cond_signal(&e->place);
+        pthread_mutex_unlock(&e->verrou);
+        fprintf(e->fichier, "[%.6f, \"o\", \"", entete.temps);
+        ecrireChaineJson(e->fichier, e->image, entete.taille);
+        fputs("\"]\n", e->fichier);
+        pthread_mutex_lock(&e->verrou);
+    }
+    pthread_mutex_unlock(&e->verrou);
+    return NULL;
+}
+
+/**
+ * @brief Ouvre le fichier d'un enregistrement et réserve son tampon.
+ * @param e Enregistrement à initialiser.
+ * @param chemin Fichier .cast à créer.
+ * @return false si le fichier ne peut être créé.
+ */
+bool ouvrirEnregistrement(Enregistrement *e, const char *chemin) {
+    e->fichier = fopen(chemin, "w");
+    if (e->fichier == NULL) return false;
+    e->anneau = malloc(TAILLEENREGISTREMENT);
+    e->image = malloc(TAILLESORTIERENDU);
+    e->debut = e->occupes = 0;
+    e->fin = false;
+    e->attentes = 0;
+    pthread_mutex_init(&e->verrou, NULL);
+    pthread_cond_init(&e->place, NULL);
+    pthread_cond_init(&e->images, NULL);
+    return true;
+}
+
+/**
+ * @brief Écrit l'en-tête asciicast v2 et démarre le fil d'écriture ;
+ * les temps des images partent d'ici.
+ * @param e Enregistrement ouvert.
+ * @param largeur Colonnes de l'écran enregistré.
+ * @param hauteur Lignes de l'écran enregistré.
+ */
+void commencerEnregistrement(Enregistrement *e, int largeur, int hauteur) {
+    const char *nomTerminal = getenv("TERM");
+    fprintf(e->fichier, "{\"version\": 2, \"width\": %d, \"height\": %d, \"timestamp\": %ld",
+            largeur, hauteur, (long)time(NULL));
+    if (nomTerminal != NULL) {
+        fputs(", \"env\": {\"TERM\": \"", e->fichier);
+        ecrireChaineJson(e->fichier, nomTerminal, strlen(nomTerminal));
+        fputs("\"}", e->fichier);
+    }
+    fputs("}\n", e->fichier);
+    clock_gettime(CLOCK_MONOTONIC, &e->depart);
+    pthread_create(&e->fil, NULL, ecrireEnContinu, e);
+}
+
+/**
+ * @brief Dépose une image envoyée au terminal, datée, dans l'anneau.
+ * N'attend le fil d'écriture que si l'anneau est plein.
+ * @param e Enregistrement commencé.
+ * @param octets Octets de l'image.
+ * @param taille Nombre d'octets (au plus TAILLESORTIERENDU).
+ */
+void enregistrer(Enregistrement *e, const char *octets, size_t taille) {
+    if (taille == 0) return;
+    struct timespec maintenant;
+    clock_gettime(CLOCK_MONOTONIC, &maintenant);
+    EnteteEnregistrement entete = {
+        .temps = (maintenant.tv_sec - e->depart.tv_sec) + (maintenant.tv_nsec - e->depart.tv_nsec) / 1e9,
+        .taille = taille
+    };
+    pthread_mutex_lock(&e->verrou);
+    if (e->occupes + sizeof(entete) + taille > TAILLEENREGISTREMENT) {
+        e->attentes++;
+        while (e->occupes + sizeof(entete) + taille > TAILLEENREGISTREMENT) {
+            pthread_cond_wait(&e->place, &e->verrou);
+        }
+    }
+    deposerAnneau(e, &entete, sizeof(entete));
+    deposerAnneau(e, octets, taille);
+    pthread_cond_signal(&e->images);
+    pthread_mutex_unlock(&e->verrou);
+}
+
+/**
+ * @brief Écrit ce qui reste dans l'anneau, arrête le fil d'écriture et
+ * ferme le fichier ; après arreterRendu, qui enregistre la sortie.
+ * @param e Enregistrement commencé.
+ */
+void fermerEnregistrement(Enregistrement *e) {
+    pthread_mutex_lock(&e->verrou);
+    e->fin = true;
+    pthread_cond_signal(&e->images);
+    pthread_mutex_unlock(&e->verrou);
+    pthread_join(e->fil, NULL);
+    fclose(e->fichier);
+    free(e->anneau);
+    free(e->image);
+    pthread_cond_destroy(&e->images);
+    pthread_cond_destroy(&e->place);
+    pthread_mutex_destroy(&e->verrou);
 }
 
 /*****************************************************